@@ -37,6 +37,7 @@ profiler=""
 num_proc_build=${num_proc_build:-""}
 num_proc_run=${num_proc_run:-""}
 num_proc_node=${num_proc_node:-""}
+num_threads_rank=${num_threads_rank:-""}
 dry_run="" # empty string = NO
 start_shell=""
 verbose=""
@@ -79,6 +80,7 @@ Options:
    -r|--run <name>          run the tests in the script <name>
    -n|--num-proc \"list\"     total number of MPI tasks to use in the tests
    -p|--proc-node \"list\"    number of MPI tasks per node to use in the tests
+   -t|--threads \"list\"      number of OpenMP threads per MPI task (default 1)
   -pp|--post-process <name> post process the results using script <name>
    -d|--dry-run             show (but do not run) the commands for the tests
    -s|--shell               execute bash shell commands before running the test
@@ -464,6 +466,7 @@ function set_num_nodes()
    fi
    echo "Running the tests using a total of $num_proc_run MPI tasks ..."
    echo "... with $num_proc_node tasks per node ..."
+   echo "... with $num_threads_rank OpenMP threads per task ..."
    echo
 }
 
@@ -549,6 +552,12 @@ case "$1" in
       echo "Missing \"list\" in --proc-node \"list\""; $exit_cmd 1; }
       num_proc_node="$1"
       ;;
+   -t|--threads)
+      shift
+      [ $# -gt 0 ] || {
+      echo "Missing \"list\" in --threads \"list\""; $exit_cmd 1; }
+      num_threads_rank="$1"
+      ;;
    -pp|--post-process)
       post_process=on
       shift
@@ -628,6 +637,21 @@ as the size of the number-of-processors-per-node list (option --proc-node)."
    echo
    $exit_cmd 1
 }
+# The threads-per-task list (option --threads) pairs with the --num-proc list;
+# a single value applies to all entries.
+num_threads_given="$num_threads_rank"
+num_threads_list=(${num_threads_rank:-1})
+if [[ "${#num_threads_list[@]}" -eq 1 ]]; then
+   for (( i = 1; i < num_proc_list_size; i++ )); do
+      num_threads_list[i]="${num_threads_list[0]}"
+   done
+elif (( ${#num_threads_list[@]} != num_proc_list_size )); then
+   echo "
+The size of the number-of-threads list (option --threads) must be one or the
+same as the size of the number-of-processors list (option --num-proc)."
+   echo
+   $exit_cmd 1
+fi
 
 
 ### Loop over compilers
@@ -741,6 +765,13 @@ $dry_run mkdir -p "$test_exe_dir" || $exit_cmd 1
 trap 'printf "\nScript interrupted.\n"; '$exit_cmd' 33' INT
 
 ## Source the test script file.
+# Read the per-machine autotune cache, written by tests/mfem_bps/autotune.sh
+autotune_cache="$OUT_DIR/autotune-cache.sh"
+if [[ -r "$autotune_cache" ]]; then
+   echo "Reading autotune cache: $autotune_cache"
+   . "$autotune_cache" || $exit_cmd 1
+fi
+
 echo "Reading test file: $test_file"
 echo
 test_required_packages=""
@@ -759,6 +790,9 @@ do
 
 num_proc_run="${num_proc_list[$num_proc_idx]}"
 num_proc_node="${num_proc_node_list[$num_proc_idx]}"
+num_threads_rank="${num_threads_list[$num_proc_idx]}"
+# Leave OMP_NUM_THREADS alone unless the number of threads was requested.
+[[ -n "$num_threads_given" ]] && export OMP_NUM_THREADS="$num_threads_rank"
 
 if [[ ${serial} -lt 1 ]]; then
     set_num_nodes || $exit_cmd 1
@@ -73,6 +73,7 @@ function setup_intel()
    # "-std=c++11 -pedantic -Wall -fdump-tree-optimized-blocks"
 
    NATIVE_CFLAG="-xHost"
+   OPENMP_CFLAG="-qopenmp"
 }
 
 function setup_gcc()
@@ -92,8 +93,13 @@ function setup_gcc()
    # The following options assume GCC:
    TEST_EXTRA_CFLAGS="-march=native --param max-completely-peel-times=3"
    # "-std=c++11 -pedantic -Wall -fdump-tree-optimized-blocks"
+   # Alternative flags searched by tests/mfem_bps/autotune.sh:
+   TEST_EXTRA_CFLAGS_LIST=("$TEST_EXTRA_CFLAGS"
+      "-march=native --param max-completely-peel-times=3 -funroll-loops"
+      "-march=native")
 
    NATIVE_CFLAG="-march=native"
+   OPENMP_CFLAG="-fopenmp"
 }
 
 function setup_gcc_no_peel()
@@ -113,6 +119,7 @@ function setup_gcc_no_peel()
    # "-std=c++11 -pedantic -Wall -fdump-tree-optimized-blocks"
 
    NATIVE_CFLAG="-march=native"
+   OPENMP_CFLAG="-fopenmp"
 }
 
 
@@ -134,6 +141,7 @@ function setup_clang()
    TEST_EXTRA_CFLAGS+=" -ffp-contract=fast"
 
    NATIVE_CFLAG="-march=native"
+   OPENMP_CFLAG="-fopenmp"
 }
 
 
@@ -141,6 +149,10 @@ function set_mpi_options()
 {
    # Run all tasks on the same node.
    num_proc_node=${num_proc_run}
+   # Keep the OpenMP threads of each task on neighboring cores.
+   if [[ "${num_threads_rank:-1}" -gt 1 ]]; then
+      export OMP_PLACES=cores OMP_PROC_BIND=close
+   fi
    compose_mpi_run_command
 }
 
@@ -29,6 +29,7 @@ function setup_intel()
    FFLAGS="-O3"
    TEST_EXTRA_CFLAGS="-xHost"
    NATIVE_CFLAG="-xHost"
+   OPENMP_CFLAG="-qopenmp"
 
    NEK5K_EXTRA_PPLIST=""
 
@@ -51,6 +52,7 @@ function setup_gcc()
    TEST_EXTRA_CFLAGS="-march=native --param max-completely-peel-times=3"
    # TEST_EXTRA_CFLAGS+=" -std=c++11 -fdump-tree-optimized-blocks"
    NATIVE_CFLAG="-march=native"
+   OPENMP_CFLAG="-fopenmp"
 
    NEK5K_EXTRA_PPLIST=""
 
@@ -79,7 +81,11 @@ function set_mpi_options()
    local partition="${partition:-pdebug}"
    MPIEXEC_OPTS="-A ${account} -p ${partition}"
    MPIEXEC_OPTS+=" --ntasks-per-node $num_proc_node"
-   if [[ "$num_proc_node" -gt "36" ]]; then
+   MPIEXEC_OPTS+=" --cpus-per-task ${num_threads_rank:-1}"
+   if [[ "${num_threads_rank:-1}" -gt 1 ]]; then
+      export OMP_PLACES=cores OMP_PROC_BIND=close
+   fi
+   if (( num_proc_node * ${num_threads_rank:-1} > 36 )); then
       MPIEXEC_OPTS+=" --overcommit"
    fi
    compose_mpi_run_command
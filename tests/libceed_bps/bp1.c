@@ -19,7 +19,7 @@
 // This test is based on libCEED's examples/petsc/bp1.c
 //
 
-const char help[] = "Solve CEED BP1 using PETSc\n";
+const char help[] = "Solve CEED BPs using PETSc\n";
 
 #include <stdbool.h>
 #include "bp1.h"
@@ -28,6 +28,47 @@ const char help[] = "Solve CEED BP1 using PETSc\n";
 #  define VecScatterCreateWithData VecScatterCreate
 #endif
 
+// Maximum number of CEED resources in -ceed_list
+#define MAX_BACKENDS 16
+
+// Target size of the element vectors of one batch of elements with
+// -structured, so that they stay in cache between the restriction, the
+// libCEED operator and the transpose restriction
+#define STRUCTURED_BATCH_BYTES (128*1024)
+
+// Preconditioners of the CG solve that use the diagonal of the operator
+typedef enum {PRECOND_NONE, PRECOND_JACOBI, PRECOND_CHEBYSHEV} PrecondType;
+static const char *const precondtypes[] = {"none", "jacobi", "chebyshev"};
+
+// PETSc log stages and events, reported by -log_view
+static PetscLogStage stage_setup, stage_restriction, stage_qfunction,
+       stage_solve;
+static PetscLogEvent event_scatter_reverse, event_ceed_apply,
+       event_scatter_forward, event_zero;
+
+static PetscErrorCode RegisterLogging(void) {
+  PetscErrorCode ierr;
+  PetscClassId classid;
+
+  PetscFunctionBeginUser;
+  ierr = PetscLogStageRegister("CEED BP Setup", &stage_setup); CHKERRQ(ierr);
+  ierr = PetscLogStageRegister("Restriction Build", &stage_restriction);
+  CHKERRQ(ierr);
+  ierr = PetscLogStageRegister("QFunction Setup", &stage_qfunction);
+  CHKERRQ(ierr);
+  ierr = PetscLogStageRegister("CEED BP Solve", &stage_solve); CHKERRQ(ierr);
+  ierr = PetscClassIdRegister("libCEED BP", &classid); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("ScatterReverse", classid,
+                               &event_scatter_reverse); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("CeedApply", classid, &event_ceed_apply);
+  CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("ScatterForward", classid,
+                               &event_scatter_forward); CHKERRQ(ierr);
+  ierr = PetscLogEventRegister("ZeroLocal", classid, &event_zero);
+  CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
 static void Split3(PetscInt size, PetscInt m[3], bool reverse) {
   for (PetscInt d=0,sizeleft=size; d<3; d++) {
     PetscInt try = (PetscInt)PetscCeilReal(PetscPowReal(sizeleft, 1./(3 - d)));
@@ -49,33 +90,63 @@ static void GlobalDof(const PetscInt p[3], const PetscInt irank[3],
   for (int d=0; d<3; d++)
     mdof[d] = degree*melem[d] + (irank[d] == p[d]-1);
 }
+// Number of dofs before rank index r along direction d, summed over the
+// process grid in that direction: only the last rank owns the extra boundary
+// layer of dofs.
+static PetscInt GlobalDofPrefix(const PetscInt p[3], PetscInt d, PetscInt r,
+                                PetscInt degree, const PetscInt melem[3]) {
+  return degree*melem[d]*r + (r == p[d]);
+}
+// Offset of the first dof owned by rank irank in the lexicographic (k fastest)
+// rank ordering, in closed form: O(1) instead of a walk over the process grid.
 static PetscInt GlobalStart(const PetscInt p[3], const PetscInt irank[3],
                             PetscInt degree, const PetscInt melem[3]) {
-  PetscInt start = 0;
-  // Dumb brute-force is easier to read
-  for (PetscInt i=0; i<p[0]; i++) {
-    for (PetscInt j=0; j<p[1]; j++) {
-      for (PetscInt k=0; k<p[2]; k++) {
-        PetscInt mdof[3], ijkrank[] = {i,j,k};
-        if (i == irank[0] && j == irank[1] && k == irank[2]) return start;
-        GlobalDof(p, ijkrank, degree, melem, mdof);
-        start += mdof[0] * mdof[1] * mdof[2];
-      }
-    }
-  }
-  return -1;
+  PetscInt mdof[3], total[3];
+  GlobalDof(p, irank, degree, melem, mdof);
+  for (int d=0; d<3; d++)
+    total[d] = GlobalDofPrefix(p, d, p[d], degree, melem);
+  return (GlobalDofPrefix(p, 0, irank[0], degree, melem)*total[1]*total[2]
+          + mdof[0]*GlobalDofPrefix(p, 1, irank[1], degree, melem)*total[2]
+          + mdof[0]*mdof[1]*GlobalDofPrefix(p, 2, irank[2], degree, melem));
 }
-static int CreateRestriction(Ceed ceed, const CeedInt melem[3],
-                             CeedInt P, CeedInt ncomp,
-                             CeedElemRestriction *Erestrict) {
-  const PetscInt Nelem = melem[0]*melem[1]*melem[2];
+// Elements touching the upper faces of the local box that are owned by a
+// neighboring rank (ghost dofs, ghost[d] is true) are process-boundary
+// elements; all other elements access only owned dofs.
+typedef enum {ELEM_ALL, ELEM_INTERIOR, ELEM_BOUNDARY} ElemSubset;
+static bool ElemInSubset(const CeedInt melem[3], const bool ghost[3],
+                         ElemSubset subset, CeedInt i, CeedInt j, CeedInt k) {
+  if (subset == ELEM_ALL) return true;
+  const bool bdry = ((ghost[0] && i == melem[0]-1) ||
+                     (ghost[1] && j == melem[1]-1) ||
+                     (ghost[2] && k == melem[2]-1));
+  return bdry == (subset == ELEM_BOUNDARY);
+}
+static CeedInt NumElemInSubset(const CeedInt melem[3], const bool ghost[3],
+                               ElemSubset subset) {
+  CeedInt nelem = 0;
+  for (CeedInt i=0; i<melem[0]; i++)
+    for (CeedInt j=0; j<melem[1]; j++)
+      for (CeedInt k=0; k<melem[2]; k++)
+        nelem += ElemInSubset(melem, ghost, subset, i, j, k);
+  return nelem;
+}
+// Restriction of the elements of 'subset' from the local vector of the local
+// box, or, if nodemap is not NULL, from a vector of nnodes nodes, where
+// nodemap maps the local nodes of the box to the nodes of that vector
+static int CreateMappedRestriction(Ceed ceed, const CeedInt melem[3],
+                                   CeedInt P, CeedInt ncomp,
+                                   const bool ghost[3], ElemSubset subset,
+                                   PetscInt nnodes, const PetscInt *nodemap,
+                                   CeedElemRestriction *Erestrict) {
+  const PetscInt Nelem = NumElemInSubset(melem, ghost, subset);
   PetscInt mdof[3], *idx, *idxp;
 
   for (int d=0; d<3; d++) mdof[d] = melem[d]*(P-1) + 1;
   idxp = idx = malloc(Nelem*P*P*P*sizeof idx[0]);
   for (CeedInt i=0; i<melem[0]; i++) {
     for (CeedInt j=0; j<melem[1]; j++) {
-      for (CeedInt k=0; k<melem[2]; k++,idxp += P*P*P) {
+      for (CeedInt k=0; k<melem[2]; k++) {
+        if (!ElemInSubset(melem, ghost, subset, i, j, k)) continue;
         for (CeedInt ii=0; ii<P; ii++) {
           for (CeedInt jj=0; jj<P; jj++) {
             for (CeedInt kk=0; kk<P; kk++) {
@@ -91,13 +162,176 @@ static int CreateRestriction(Ceed ceed, const CeedInt melem[3],
             }
           }
         }
+        if (nodemap)
+          for (CeedInt l=0; l<P*P*P; l++) idxp[l] = nodemap[idxp[l]];
+        idxp += P*P*P;
       }
     }
   }
-  CeedElemRestrictionCreate(ceed, Nelem, P*P*P, mdof[0]*mdof[1]*mdof[2], ncomp,
+  CeedElemRestrictionCreate(ceed, Nelem, P*P*P,
+                            nodemap ? nnodes : mdof[0]*mdof[1]*mdof[2], ncomp,
                             CEED_MEM_HOST, CEED_OWN_POINTER, idx, Erestrict);
   PetscFunctionReturn(0);
 }
+static int CreateRestriction(Ceed ceed, const CeedInt melem[3],
+                             CeedInt P, CeedInt ncomp, const bool ghost[3],
+                             ElemSubset subset,
+                             CeedElemRestriction *Erestrict) {
+  return CreateMappedRestriction(ceed, melem, P, ncomp, ghost, subset, 0, NULL,
+                                 Erestrict);
+}
+// Restriction selecting the quadrature data of a subset of the elements from
+// the quadrature data of all local elements (stored element by element).
+static int CreateQDataRestriction(Ceed ceed, const CeedInt melem[3],
+                                  CeedInt Q3, CeedInt ncomp,
+                                  const bool ghost[3],
+                                  ElemSubset subset,
+                                  CeedElemRestriction *Erestrict) {
+  const PetscInt Nelem = NumElemInSubset(melem, ghost, subset);
+  PetscInt *idx, *idxp, e = 0;
+
+  idxp = idx = malloc(Nelem*Q3*sizeof idx[0]);
+  for (CeedInt i=0; i<melem[0]; i++) {
+    for (CeedInt j=0; j<melem[1]; j++) {
+      for (CeedInt k=0; k<melem[2]; k++,e++) {
+        if (!ElemInSubset(melem, ghost, subset, i, j, k)) continue;
+        for (CeedInt q=0; q<Q3; q++) idxp[q] = e*Q3 + q;
+        idxp += Q3;
+      }
+    }
+  }
+  CeedElemRestrictionCreate(ceed, Nelem, Q3, e*Q3, ncomp, CEED_MEM_HOST,
+                            CEED_OWN_POINTER, idx, Erestrict);
+  PetscFunctionReturn(0);
+}
+
+// Structured element restriction of the local box (-structured): the offsets
+// of the element nodes in the local vector are computed from the element
+// coordinates (i,j,k) and the strides of the local nodes, so no index array is
+// stored or streamed. The elements are processed in batches of consecutive
+// elements (see StructuredBatchSize); the element vector of a batch has the
+// layout of the L-vector of an identity restriction: [ncomp][nb][P^3], with
+// the (k,j,i) node ordering of CreateRestriction. StructuredRestrict computes
+// ue = R uloc for the nb elements from e0, and StructuredRestrictTranspose
+// computes vloc += R^T ue.
+static void StructuredRestrict(const CeedInt melem[3], CeedInt P,
+                               CeedInt ncomp, PetscInt lsize, CeedInt e0,
+                               CeedInt nb, const CeedScalar *uloc,
+                               CeedScalar *ue) {
+  const CeedInt P3 = P*P*P;
+  const PetscInt mdof[3] = {melem[0]*(P-1) + 1, melem[1]*(P-1) + 1,
+                            melem[2]*(P-1) + 1
+                           };
+
+  for (CeedInt c=0; c<ncomp; c++) {
+    for (CeedInt e=0; e<nb; e++) {
+      const CeedInt i = (e0+e)/(melem[1]*melem[2]),
+                    j = (e0+e)/melem[2]%melem[1], k = (e0+e)%melem[2];
+      const CeedScalar *u = uloc + c*lsize + ((i*(P-1))*mdof[1] +
+                            j*(P-1))*mdof[2] + k*(P-1);
+      CeedScalar *v = ue + (c*nb + e)*P3;
+      for (CeedInt ii=0; ii<P; ii++)
+        for (CeedInt jj=0; jj<P; jj++)
+          for (CeedInt kk=0; kk<P; kk++)
+            v[ii+P*(jj+P*kk)] = u[(ii*mdof[1]+jj)*mdof[2]+kk];
+    }
+  }
+}
+static void StructuredRestrictTranspose(const CeedInt melem[3], CeedInt P,
+                                        CeedInt ncomp, PetscInt lsize,
+                                        CeedInt e0, CeedInt nb,
+                                        const CeedScalar *ue,
+                                        CeedScalar *vloc) {
+  const CeedInt P3 = P*P*P;
+  const PetscInt mdof[3] = {melem[0]*(P-1) + 1, melem[1]*(P-1) + 1,
+                            melem[2]*(P-1) + 1
+                           };
+
+  for (CeedInt c=0; c<ncomp; c++) {
+    for (CeedInt e=0; e<nb; e++) {
+      const CeedInt i = (e0+e)/(melem[1]*melem[2]),
+                    j = (e0+e)/melem[2]%melem[1], k = (e0+e)%melem[2];
+      CeedScalar *v = vloc + c*lsize + ((i*(P-1))*mdof[1] +
+                      j*(P-1))*mdof[2] + k*(P-1);
+      const CeedScalar *u = ue + (c*nb + e)*P3;
+      for (CeedInt ii=0; ii<P; ii++)
+        for (CeedInt jj=0; jj<P; jj++)
+          for (CeedInt kk=0; kk<P; kk++)
+            v[(ii*mdof[1]+jj)*mdof[2]+kk] += u[ii+P*(jj+P*kk)];
+    }
+  }
+}
+
+// Number of elements per batch of the structured restriction: whole rows of
+// melem[2] elements, as many as fit in STRUCTURED_BATCH_BYTES per element
+// vector (at least one row), dividing the local elements into equal batches
+// so that one libCEED operator applies all of them.
+static CeedInt StructuredBatchSize(const CeedInt melem[3], CeedInt P,
+                                   CeedInt ncomp) {
+  const CeedInt nrows = melem[0]*melem[1],
+                rowbytes = melem[2]*ncomp*P*P*P*sizeof(CeedScalar);
+  CeedInt r = 1;
+
+  for (CeedInt d=2; d<=nrows; d++)
+    if (nrows % d == 0 && d*rowbytes <= STRUCTURED_BATCH_BYTES) r = d;
+  return r*melem[2];
+}
+
+// CEED benchmark problems: BP1 and BP2 use the mass operator, BP3-BP6 the
+// diffusion operator, with 1 (odd BPs) or 3 (even BPs) components; BP5 and
+// BP6 use Q=P Gauss-Lobatto quadrature points, collocated with the nodes.
+typedef int (*QFunctionUser)(void *, CeedInt, const CeedScalar *const *,
+                             CeedScalar *const *);
+typedef struct {
+  CeedInt ncomp, qdatasize;
+  bool diffusion, collocated;
+  QFunctionUser setup, apply;
+  const char *setupname, *applyname;
+} BPData;
+static const BPData bpdata[6] = {
+  { 1, 1, false, false, SetupMass, Mass,
+    __FILE__ ":SetupMass", __FILE__ ":Mass" },
+  { 3, 1, false, false, SetupMass, Mass3,
+    __FILE__ ":SetupMass", __FILE__ ":Mass3" },
+  { 1, 6, true, false, SetupDiff, Diff,
+    __FILE__ ":SetupDiff", __FILE__ ":Diff" },
+  { 3, 6, true, false, SetupDiff, Diff3,
+    __FILE__ ":SetupDiff", __FILE__ ":Diff3" },
+  { 1, 6, true, true, SetupDiff, Diff,
+    __FILE__ ":SetupDiff", __FILE__ ":Diff" },
+  { 3, 6, true, true, SetupDiff, Diff3,
+    __FILE__ ":SetupDiff", __FILE__ ":Diff3" },
+};
+
+// Is the local node (i,j,k) on the boundary of the global box?
+static bool GlobalBoundaryNode(const PetscInt p[3], const PetscInt irank[3],
+                               PetscInt degree, const PetscInt melem[3],
+                               PetscInt i, PetscInt j, PetscInt k) {
+  const PetscInt l[3] = {i, j, k};
+  for (int d=0; d<3; d++) {
+    const PetscInt g = irank[d]*melem[d]*degree + l[d];
+    if (g == 0 || g == p[d]*melem[d]*degree) return true;
+  }
+  return false;
+}
+
+// Used with -threads: the local elements are split into slabs along the first
+// direction, one per thread. Each slab has its own libCEED context and
+// operator, acting on the slice of the local vectors containing the nodes of
+// the slab, with a thread-private output slice.
+typedef struct {
+  Ceed ceed;
+  CeedBasis basisu;
+  CeedElemRestriction Erestrictu, Erestrictqdi;
+  CeedQFunction qf_apply;
+  CeedOperator op_apply;
+  CeedVector qdata, xceed, yceed;
+  // First local node and number of local nodes of the slice
+  PetscInt offset, size;
+  // Input and output slices, [ncomp][size], bound to xceed and yceed; the
+  // input slice is only copied with more than one component
+  CeedScalar *x, *y;
+} ThreadOp;
 
 typedef struct User_ *User;
 struct User_ {
@@ -106,42 +340,461 @@ struct User_ {
   Vec Xloc, Yloc;
   CeedVector xceed, yceed;
   CeedOperator op;
-  CeedVector rho;
+  CeedVector qdata;
   Ceed ceed;
+  // Number of components and of local nodes: the local vectors store the
+  // components one after the other, the global vectors interleave them
+  CeedInt ncomp;
+  PetscInt lsize;
+  // Homogeneous Dirichlet boundary conditions (diffusion problems): the local
+  // nodes and the owned nodes on the boundary of the global box
+  PetscInt nbcloc, *bcloc, nbcown, *bcown;
+  // Used by MatMult_CeedOverlap: the scatter of the ghost dofs only, the
+  // operators on the interior and on the process-boundary elements, the
+  // boundary element output, the local indices of the owned nodes, and the
+  // time spent waiting for the communication. Ybloc only stores the nbnode
+  // nodes of the process-boundary elements, [ncomp][nbnode]; bghost scatters
+  // its ghost dofs, and bnodeown is the owned index of each node, or -1.
+  VecScatter ghost, bghost;
+  CeedOperator op_interior, op_boundary;
+  Vec Ybloc;
+  CeedVector ybceed;
+  PetscInt nowned, *ownedloc, nbnode, *bnodeown;
+  PetscInt num_mult;
+  double wait_time;
+  // Used with -bind: the arrays of Xloc, Yloc and Ybloc, bound once to xceed,
+  // yceed and ybceed for all operator applications
+  PetscBool bound;
+  PetscScalar *xloc, *yloc, *ybloc;
+  // Used with -structured: the local elements and the nodes per direction of
+  // the structured restriction, and the elements per batch; op then applies
+  // one batch, xceed and yceed are the element vectors of a batch, and qbatch,
+  // the quadrature data input of op, is bound in turn to each batch of
+  // qdbatches, the quadrature data stored batch by batch
+  PetscBool structured;
+  CeedInt melem[3], P, nbatch;
+  CeedVector qbatch;
+  CeedScalar *qdbatches;
+  // Used with -threads: the per-thread operators
+  PetscInt nthreads;
+  ThreadOp *tops;
+  // The diagonal of the operator, computed by ComputeDiagonal when it is
+  // first needed with the current backend
+  Vec diag;
+  PetscBool diag_valid;
 };
 
-// This function uses libCEED to compute the action of the mass matrix
-static PetscErrorCode MatMult_Mass(Mat A, Vec X, Vec Y) {
+// Apply the per-thread operators concurrently and add their output slices to
+// the local vector y. With one component, the input slice of a thread is a
+// contiguous part of x, bound to its xceed without a copy. Adjacent slabs
+// only share the node plane between them: each thread adds the other planes
+// of its output slice directly, and the shared planes are then added as the
+// sum of the two slices, so the result does not depend on the scheduling.
+static void ApplyThreaded(User user, const PetscScalar *x, PetscScalar *y) {
+  const CeedInt ncomp = user->ncomp, P = user->P;
+  const PetscInt lsize = user->lsize, nthreads = user->nthreads,
+                 plane = (user->melem[1]*(P-1) + 1)*(user->melem[2]*(P-1) + 1);
+
+  #pragma omp parallel num_threads(nthreads)
+  {
+    #pragma omp for schedule(static,1)
+    for (PetscInt t=0; t<nthreads; t++) {
+      ThreadOp *top = &user->tops[t];
+      const PetscInt lbegin = t > 0 ? plane : 0,
+                     lend = top->size - (t < nthreads-1 ? plane : 0);
+      if (ncomp == 1) {
+        CeedVectorSetArray(top->xceed, CEED_MEM_HOST, CEED_USE_POINTER,
+                           (CeedScalar *)x + top->offset);
+      } else {
+        for (CeedInt c=0; c<ncomp; c++)
+          for (PetscInt l=0; l<top->size; l++)
+            top->x[c*top->size + l] = x[c*lsize + top->offset + l];
+      }
+      CeedOperatorApply(top->op_apply, top->xceed, top->yceed,
+                        CEED_REQUEST_IMMEDIATE);
+      for (CeedInt c=0; c<ncomp; c++)
+        for (PetscInt l=lbegin; l<lend; l++)
+          y[c*lsize + top->offset + l] += top->y[c*top->size + l];
+    }
+    // Shared plane between the slabs of threads t and t+1
+    #pragma omp for schedule(static)
+    for (PetscInt t=0; t<nthreads-1; t++) {
+      const ThreadOp *top = &user->tops[t], *next = &user->tops[t+1];
+      for (CeedInt c=0; c<ncomp; c++)
+        for (PetscInt l=0; l<plane; l++)
+          y[c*lsize + next->offset + l] +=
+            top->y[c*top->size + top->size - plane + l] +
+            next->y[c*next->size + l];
+    }
+  }
+}
+
+// Apply the batch operator of -structured to the local vector x, one batch of
+// elements at a time, adding the result to the local vector y
+static void ApplyStructured(User user, const PetscScalar *x, PetscScalar *y) {
+  const CeedInt nb = user->nbatch,
+                nelem = user->melem[0]*user->melem[1]*user->melem[2];
+  CeedInt qbsize;
+  CeedScalar *ue;
+  const CeedScalar *ve;
+
+  CeedVectorGetLength(user->qbatch, &qbsize);
+  for (CeedInt e0=0; e0<nelem; e0+=nb) {
+    CeedVectorSetArray(user->qbatch, CEED_MEM_HOST, CEED_USE_POINTER,
+                       user->qdbatches + (e0/nb)*qbsize);
+    CeedVectorGetArray(user->xceed, CEED_MEM_HOST, &ue);
+    StructuredRestrict(user->melem, user->P, user->ncomp, user->lsize, e0, nb,
+                       x, ue);
+    CeedVectorRestoreArray(user->xceed, &ue);
+    CeedOperatorApply(user->op, user->xceed, user->yceed,
+                      CEED_REQUEST_IMMEDIATE);
+    CeedVectorGetArrayRead(user->yceed, CEED_MEM_HOST, &ve);
+    StructuredRestrictTranspose(user->melem, user->P, user->ncomp, user->lsize,
+                                e0, nb, ve, y);
+    CeedVectorRestoreArrayRead(user->yceed, &ve);
+  }
+}
+
+// The operator acts on the subspace with homogeneous Dirichlet boundary
+// conditions: the boundary values of the local input are ignored ...
+static void ZeroBoundaryLocal(User user, PetscScalar *xloc) {
+  for (CeedInt c=0; c<user->ncomp; c++)
+    for (PetscInt i=0; i<user->nbcloc; i++)
+      xloc[user->bcloc[i] + c*user->lsize] = 0.;
+}
+
+// ... and the operator is the identity on the boundary dofs
+static PetscErrorCode ApplyBoundaryIdentity(User user, Vec X, Vec Y) {
+  PetscErrorCode ierr;
+  const PetscScalar *x;
+  PetscScalar *y;
+  const CeedInt ncomp = user->ncomp;
+
+  PetscFunctionBeginUser;
+  if (!user->nbcown) PetscFunctionReturn(0);
+  ierr = VecGetArrayRead(X, &x); CHKERRQ(ierr);
+  ierr = VecGetArray(Y, &y); CHKERRQ(ierr);
+  for (PetscInt i=0; i<user->nbcown; i++)
+    for (CeedInt c=0; c<ncomp; c++)
+      y[ncomp*user->bcown[i]+c] = x[ncomp*user->bcown[i]+c];
+  ierr = VecRestoreArray(Y, &y); CHKERRQ(ierr);
+  ierr = VecRestoreArrayRead(X, &x); CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+// Apply the operator to the local vector x, adding the result to the local
+// vector y (the unstructured single-threaded path overwrites y)
+static void ApplyLocal(User user, PetscScalar *x, PetscScalar *y) {
+  if (user->structured) {
+    ApplyStructured(user, x, y);
+  } else if (user->nthreads > 1) {
+    ApplyThreaded(user, x, y);
+  } else {
+    CeedVectorSetArray(user->xceed, CEED_MEM_HOST, CEED_USE_POINTER, x);
+    CeedVectorSetArray(user->yceed, CEED_MEM_HOST, CEED_USE_POINTER, y);
+    CeedOperatorApply(user->op, user->xceed, user->yceed,
+                      CEED_REQUEST_IMMEDIATE);
+  }
+}
+
+// This function uses libCEED to compute the action of the operator
+static PetscErrorCode MatMult_Ceed(Mat A, Vec X, Vec Y) {
   PetscErrorCode ierr;
   User user;
   PetscScalar *x, *y;
 
   PetscFunctionBeginUser;
   ierr = MatShellGetContext(A, &user); CHKERRQ(ierr);
+  ierr = PetscLogEventBegin(event_scatter_reverse, X, 0, 0, 0); CHKERRQ(ierr);
   ierr = VecScatterBegin(user->ltog, X, user->Xloc, INSERT_VALUES,
                          SCATTER_REVERSE); CHKERRQ(ierr);
   ierr = VecScatterEnd(user->ltog, X, user->Xloc, INSERT_VALUES, SCATTER_REVERSE);
   CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(event_scatter_reverse, X, 0, 0, 0); CHKERRQ(ierr);
+  ierr = PetscLogEventBegin(event_zero, 0, 0, 0, 0); CHKERRQ(ierr);
   ierr = VecZeroEntries(user->Yloc); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(event_zero, 0, 0, 0, 0); CHKERRQ(ierr);
 
-  ierr = VecGetArrayRead(user->Xloc, (const PetscScalar**)&x); CHKERRQ(ierr);
+  ierr = PetscLogEventBegin(event_ceed_apply, 0, 0, 0, 0); CHKERRQ(ierr);
+  ierr = VecGetArray(user->Xloc, &x); CHKERRQ(ierr);
   ierr = VecGetArray(user->Yloc, &y); CHKERRQ(ierr);
-  CeedVectorSetArray(user->xceed, CEED_MEM_HOST, CEED_USE_POINTER, x);
-  CeedVectorSetArray(user->yceed, CEED_MEM_HOST, CEED_USE_POINTER, y);
-
-  CeedOperatorApply(user->op, user->xceed, user->yceed,
-                    CEED_REQUEST_IMMEDIATE);
+  ZeroBoundaryLocal(user, x);
+  ApplyLocal(user, x, y);
 
-  ierr = VecRestoreArrayRead(user->Xloc, (const PetscScalar**)&x); CHKERRQ(ierr);
+  ierr = VecRestoreArray(user->Xloc, &x); CHKERRQ(ierr);
   ierr = VecRestoreArray(user->Yloc, &y); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(event_ceed_apply, 0, 0, 0, 0); CHKERRQ(ierr);
 
   if (Y) {
+    ierr = PetscLogEventBegin(event_zero, Y, 0, 0, 0); CHKERRQ(ierr);
     ierr = VecZeroEntries(Y); CHKERRQ(ierr);
+    ierr = PetscLogEventEnd(event_zero, Y, 0, 0, 0); CHKERRQ(ierr);
+    ierr = PetscLogEventBegin(event_scatter_forward, Y, 0, 0, 0); CHKERRQ(ierr);
     ierr = VecScatterBegin(user->ltog, user->Yloc, Y, ADD_VALUES, SCATTER_FORWARD);
     CHKERRQ(ierr);
     ierr = VecScatterEnd(user->ltog, user->Yloc, Y, ADD_VALUES, SCATTER_FORWARD);
     CHKERRQ(ierr);
+    ierr = PetscLogEventEnd(event_scatter_forward, Y, 0, 0, 0); CHKERRQ(ierr);
+    ierr = ApplyBoundaryIdentity(user, X, Y); CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+// Same as MatMult_Ceed, with the local vectors bound to the CeedVectors once at
+// setup. CeedOperatorApply overwrites yceed, so Yloc is not zeroed, and the
+// owned dofs of Y are set from Yloc before the ghost contributions are added,
+// so Y is not zeroed either.
+static PetscErrorCode MatMult_CeedBound(Mat A, Vec X, Vec Y) {
+  PetscErrorCode ierr;
+  User user;
+  const PetscScalar *x;
+  PetscScalar *y;
+  PetscInt lsize;
+  CeedInt ncomp;
+
+  PetscFunctionBeginUser;
+  ierr = MatShellGetContext(A, &user); CHKERRQ(ierr);
+  lsize = user->lsize;
+  ncomp = user->ncomp;
+  ierr = PetscLogEventBegin(event_scatter_reverse, X, 0, 0, 0); CHKERRQ(ierr);
+  ierr = VecScatterBegin(user->ghost, X, user->Xloc, INSERT_VALUES,
+                         SCATTER_REVERSE); CHKERRQ(ierr);
+  ierr = VecGetArrayRead(X, &x); CHKERRQ(ierr);
+  for (PetscInt i=0; i<user->nowned; i++)
+    for (CeedInt c=0; c<ncomp; c++)
+      user->xloc[user->ownedloc[i] + c*lsize] = x[ncomp*i+c];
+  ierr = VecRestoreArrayRead(X, &x); CHKERRQ(ierr);
+  ierr = VecScatterEnd(user->ghost, X, user->Xloc, INSERT_VALUES,
+                       SCATTER_REVERSE); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(event_scatter_reverse, X, 0, 0, 0); CHKERRQ(ierr);
+
+  ierr = PetscLogEventBegin(event_ceed_apply, 0, 0, 0, 0); CHKERRQ(ierr);
+  ZeroBoundaryLocal(user, user->xloc);
+  CeedOperatorApply(user->op, user->xceed, user->yceed,
+                    CEED_REQUEST_IMMEDIATE);
+  ierr = PetscLogEventEnd(event_ceed_apply, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  if (Y) {
+    ierr = PetscLogEventBegin(event_scatter_forward, Y, 0, 0, 0); CHKERRQ(ierr);
+    ierr = VecScatterBegin(user->ghost, user->Yloc, Y, ADD_VALUES,
+                           SCATTER_FORWARD); CHKERRQ(ierr);
+    ierr = VecGetArray(Y, &y); CHKERRQ(ierr);
+    for (PetscInt i=0; i<user->nowned; i++)
+      for (CeedInt c=0; c<ncomp; c++)
+        y[ncomp*i+c] = user->yloc[user->ownedloc[i] + c*lsize];
+    ierr = VecRestoreArray(Y, &y); CHKERRQ(ierr);
+    ierr = VecScatterEnd(user->ghost, user->Yloc, Y, ADD_VALUES,
+                         SCATTER_FORWARD); CHKERRQ(ierr);
+    ierr = PetscLogEventEnd(event_scatter_forward, Y, 0, 0, 0); CHKERRQ(ierr);
+    ierr = ApplyBoundaryIdentity(user, X, Y); CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+// Same as MatMult_Ceed, with the communication overlapped with computation:
+// the interior elements, which only access owned dofs, are applied while the
+// ghost dofs are received, and the contributions of the process-boundary
+// elements to the ghost dofs are sent while the owned dofs are summed.
+static PetscErrorCode MatMult_CeedOverlap(Mat A, Vec X, Vec Y) {
+  PetscErrorCode ierr;
+  User user;
+  const PetscScalar *x, *yloc, *ybloc;
+  PetscScalar *xloc, *y;
+  PetscInt lsize;
+  CeedInt ncomp;
+  double my_rt_start;
+
+  PetscFunctionBeginUser;
+  ierr = MatShellGetContext(A, &user); CHKERRQ(ierr);
+  lsize = user->lsize;
+  ncomp = user->ncomp;
+  ierr = PetscLogEventBegin(event_scatter_reverse, X, 0, 0, 0); CHKERRQ(ierr);
+  ierr = VecScatterBegin(user->ghost, X, user->Xloc, INSERT_VALUES,
+                         SCATTER_REVERSE); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(event_scatter_reverse, X, 0, 0, 0); CHKERRQ(ierr);
+  if (!user->bound) {
+    ierr = PetscLogEventBegin(event_zero, 0, 0, 0, 0); CHKERRQ(ierr);
+    ierr = VecZeroEntries(user->Yloc); CHKERRQ(ierr);
+    ierr = VecZeroEntries(user->Ybloc); CHKERRQ(ierr);
+    ierr = PetscLogEventEnd(event_zero, 0, 0, 0, 0); CHKERRQ(ierr);
+  }
+
+  // Owned dofs: local copy, then the interior elements
+  ierr = PetscLogEventBegin(event_ceed_apply, 0, 0, 0, 0); CHKERRQ(ierr);
+  ierr = VecGetArrayRead(X, &x); CHKERRQ(ierr);
+  ierr = VecGetArray(user->Xloc, &xloc); CHKERRQ(ierr);
+  for (PetscInt i=0; i<user->nowned; i++)
+    for (CeedInt c=0; c<ncomp; c++)
+      xloc[user->ownedloc[i] + c*lsize] = x[ncomp*i+c];
+  ZeroBoundaryLocal(user, xloc);
+  ierr = VecRestoreArrayRead(X, &x); CHKERRQ(ierr);
+  ierr = VecGetArray(user->Yloc, &y); CHKERRQ(ierr);
+  if (!user->bound) {
+    CeedVectorSetArray(user->xceed, CEED_MEM_HOST, CEED_USE_POINTER, xloc);
+    CeedVectorSetArray(user->yceed, CEED_MEM_HOST, CEED_USE_POINTER, y);
   }
+  CeedOperatorApply(user->op_interior, user->xceed, user->yceed,
+                    CEED_REQUEST_IMMEDIATE);
+  ierr = VecRestoreArray(user->Yloc, &y); CHKERRQ(ierr);
+  ierr = VecRestoreArray(user->Xloc, &xloc); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(event_ceed_apply, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  ierr = PetscLogEventBegin(event_scatter_reverse, X, 0, 0, 0); CHKERRQ(ierr);
+  my_rt_start = MPI_Wtime();
+  ierr = VecScatterEnd(user->ghost, X, user->Xloc, INSERT_VALUES,
+                       SCATTER_REVERSE); CHKERRQ(ierr);
+  user->wait_time += MPI_Wtime() - my_rt_start;
+  ierr = PetscLogEventEnd(event_scatter_reverse, X, 0, 0, 0); CHKERRQ(ierr);
+
+  // Process-boundary elements, using the received ghost dofs
+  ierr = PetscLogEventBegin(event_ceed_apply, 0, 0, 0, 0); CHKERRQ(ierr);
+  ierr = VecGetArray(user->Xloc, &xloc); CHKERRQ(ierr);
+  ierr = VecGetArray(user->Ybloc, &y); CHKERRQ(ierr);
+  ZeroBoundaryLocal(user, xloc);
+  if (!user->bound) {
+    CeedVectorSetArray(user->xceed, CEED_MEM_HOST, CEED_USE_POINTER, xloc);
+    CeedVectorSetArray(user->ybceed, CEED_MEM_HOST, CEED_USE_POINTER, y);
+  }
+  CeedOperatorApply(user->op_boundary, user->xceed, user->ybceed,
+                    CEED_REQUEST_IMMEDIATE);
+  ierr = VecRestoreArray(user->Xloc, &xloc); CHKERRQ(ierr);
+  ierr = VecRestoreArray(user->Ybloc, &y); CHKERRQ(ierr);
+  ierr = PetscLogEventEnd(event_ceed_apply, 0, 0, 0, 0); CHKERRQ(ierr);
+
+  if (Y) {
+    // The ghost dofs are all owned by other ranks, so Y is only modified in
+    // VecScatterEnd and the owned dofs can be set while the data is in flight
+    const PetscInt nbnode = user->nbnode;
+    ierr = PetscLogEventBegin(event_scatter_forward, Y, 0, 0, 0); CHKERRQ(ierr);
+    ierr = VecScatterBegin(user->bghost, user->Ybloc, Y, ADD_VALUES,
+                           SCATTER_FORWARD); CHKERRQ(ierr);
+    ierr = VecGetArray(Y, &y); CHKERRQ(ierr);
+    ierr = VecGetArrayRead(user->Yloc, &yloc); CHKERRQ(ierr);
+    ierr = VecGetArrayRead(user->Ybloc, &ybloc); CHKERRQ(ierr);
+    for (PetscInt i=0; i<user->nowned; i++)
+      for (CeedInt c=0; c<ncomp; c++)
+        y[ncomp*i+c] = yloc[user->ownedloc[i] + c*lsize];
+    for (PetscInt b=0; b<nbnode; b++) {
+      const PetscInt i = user->bnodeown[b];
+      if (i < 0) continue;
+      for (CeedInt c=0; c<ncomp; c++)
+        y[ncomp*i+c] += ybloc[b + c*nbnode];
+    }
+    ierr = VecRestoreArrayRead(user->Ybloc, &ybloc); CHKERRQ(ierr);
+    ierr = VecRestoreArrayRead(user->Yloc, &yloc); CHKERRQ(ierr);
+    ierr = VecRestoreArray(Y, &y); CHKERRQ(ierr);
+    my_rt_start = MPI_Wtime();
+    ierr = VecScatterEnd(user->bghost, user->Ybloc, Y, ADD_VALUES,
+                         SCATTER_FORWARD); CHKERRQ(ierr);
+    user->wait_time += MPI_Wtime() - my_rt_start;
+    ierr = PetscLogEventEnd(event_scatter_forward, Y, 0, 0, 0); CHKERRQ(ierr);
+    ierr = ApplyBoundaryIdentity(user, X, Y); CHKERRQ(ierr);
+  }
+  user->num_mult++;
+  PetscFunctionReturn(0);
+}
+
+// Compute the diagonal of the operator with the local libCEED operator. Two
+// local nodes (i,j,k) and (i',j',k') of the same element differ by at most the
+// degree in each index, so the nodes of each of the P^3 colors
+// (i%P, j%P, k%P) are in different elements, and applying the operator to the
+// indicator vector of one color gives the diagonal entries of that color.
+// The local diagonals are then summed into the global diagonal, which is 1 at
+// the Dirichlet boundary dofs.
+static PetscErrorCode ComputeDiagonal(User user, Vec D) {
+  PetscErrorCode ierr;
+  const CeedInt ncomp = user->ncomp, P = user->P;
+  const PetscInt lsize = user->lsize,
+                 ldof[3] = {user->melem[0]*(P-1) + 1, user->melem[1]*(P-1) + 1,
+                            user->melem[2]*(P-1) + 1
+                           };
+  Vec Dloc;
+  PetscScalar *x, *y, *d;
+
+  PetscFunctionBeginUser;
+  ierr = VecDuplicate(user->Xloc, &Dloc); CHKERRQ(ierr);
+  ierr = VecGetArray(Dloc, &d); CHKERRQ(ierr);
+  for (CeedInt color=0; color<P*P*P; color++) {
+    const CeedInt ci = color/(P*P), cj = (color/P)%P, ck = color%P;
+    ierr = VecZeroEntries(user->Xloc); CHKERRQ(ierr);
+    ierr = VecZeroEntries(user->Yloc); CHKERRQ(ierr);
+    ierr = VecGetArray(user->Xloc, &x); CHKERRQ(ierr);
+    ierr = VecGetArray(user->Yloc, &y); CHKERRQ(ierr);
+    // The components are independent, so they are probed together
+    for (PetscInt i=ci; i<ldof[0]; i+=P)
+      for (PetscInt j=cj; j<ldof[1]; j+=P)
+        for (PetscInt k=ck; k<ldof[2]; k+=P)
+          for (CeedInt c=0; c<ncomp; c++)
+            x[(i*ldof[1]+j)*ldof[2]+k + c*lsize] = 1.;
+    ApplyLocal(user, x, y);
+    for (PetscInt i=ci; i<ldof[0]; i+=P)
+      for (PetscInt j=cj; j<ldof[1]; j+=P)
+        for (PetscInt k=ck; k<ldof[2]; k+=P)
+          for (CeedInt c=0; c<ncomp; c++) {
+            const PetscInt l = (i*ldof[1]+j)*ldof[2]+k + c*lsize;
+            d[l] = y[l];
+          }
+    ierr = VecRestoreArray(user->Xloc, &x); CHKERRQ(ierr);
+    ierr = VecRestoreArray(user->Yloc, &y); CHKERRQ(ierr);
+  }
+  ierr = VecRestoreArray(Dloc, &d); CHKERRQ(ierr);
+
+  ierr = VecZeroEntries(D); CHKERRQ(ierr);
+  ierr = VecScatterBegin(user->ltog, Dloc, D, ADD_VALUES, SCATTER_FORWARD);
+  CHKERRQ(ierr);
+  ierr = VecScatterEnd(user->ltog, Dloc, D, ADD_VALUES, SCATTER_FORWARD);
+  CHKERRQ(ierr);
+  ierr = VecDestroy(&Dloc); CHKERRQ(ierr);
+  if (user->nbcown) {
+    ierr = VecGetArray(D, &d); CHKERRQ(ierr);
+    for (PetscInt i=0; i<user->nbcown; i++)
+      for (CeedInt c=0; c<ncomp; c++)
+        d[ncomp*user->bcown[i]+c] = 1.;
+    ierr = VecRestoreArray(D, &d); CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode MatGetDiagonal_Ceed(Mat A, Vec D) {
+  PetscErrorCode ierr;
+  User user;
+
+  PetscFunctionBeginUser;
+  ierr = MatShellGetContext(A, &user); CHKERRQ(ierr);
+  if (!user->diag_valid) {
+    ierr = ComputeDiagonal(user, user->diag); CHKERRQ(ierr);
+    user->diag_valid = PETSC_TRUE;
+  }
+  ierr = VecCopy(user->diag, D); CHKERRQ(ierr);
+  PetscFunctionReturn(0);
+}
+
+// Time the ghost dof exchange of MatMult_CeedOverlap without any overlapping
+// computation; returns the maximum over all ranks of the time per MatMult.
+static PetscErrorCode TimeGhostExchange(User user, Vec X, PetscInt n,
+                                        double *rt) {
+  PetscErrorCode ierr;
+  Vec Y;
+  double my_rt_start, my_rt;
+
+  PetscFunctionBeginUser;
+  ierr = VecDuplicate(X, &Y); CHKERRQ(ierr);
+  ierr = MPI_Barrier(user->comm); CHKERRQ(ierr);
+  my_rt_start = MPI_Wtime();
+  for (PetscInt i=0; i<n; i++) {
+    ierr = VecScatterBegin(user->ghost, X, user->Xloc, INSERT_VALUES,
+                           SCATTER_REVERSE); CHKERRQ(ierr);
+    ierr = VecScatterEnd(user->ghost, X, user->Xloc, INSERT_VALUES,
+                         SCATTER_REVERSE); CHKERRQ(ierr);
+    ierr = VecScatterBegin(user->bghost, user->Ybloc, Y, ADD_VALUES,
+                           SCATTER_FORWARD); CHKERRQ(ierr);
+    ierr = VecScatterEnd(user->bghost, user->Ybloc, Y, ADD_VALUES,
+                         SCATTER_FORWARD); CHKERRQ(ierr);
+  }
+  my_rt = (MPI_Wtime() - my_rt_start)/n;
+  ierr = MPI_Allreduce(&my_rt, rt, 1, MPI_DOUBLE, MPI_MAX, user->comm);
+  CHKERRQ(ierr);
+  ierr = VecDestroy(&Y); CHKERRQ(ierr);
   PetscFunctionReturn(0);
 }
 
@@ -149,7 +802,7 @@ static PetscErrorCode ComputeErrorMax(User user, CeedOperator op_error, Vec X,
                                       CeedVector target, PetscReal *maxerror) {
   PetscErrorCode ierr;
   PetscScalar *x;
-  CeedVector collocated_error;
+  CeedVector collocated_error, u = user->xceed;
   CeedInt length;
 
   PetscFunctionBeginUser;
@@ -160,10 +813,23 @@ static PetscErrorCode ComputeErrorMax(User user, CeedOperator op_error, Vec X,
   ierr = VecScatterEnd(user->ltog, X, user->Xloc, INSERT_VALUES, SCATTER_REVERSE);
   CHKERRQ(ierr);
   ierr = VecGetArrayRead(user->Xloc, (const PetscScalar**)&x); CHKERRQ(ierr);
-  CeedVectorSetArray(user->xceed, CEED_MEM_HOST, CEED_USE_POINTER, x);
-  CeedOperatorApply(op_error, user->xceed, collocated_error,
-                    CEED_REQUEST_IMMEDIATE);
+  if (user->structured) {
+    // op_error acts on the element vector of all local elements, only
+    // allocated here
+    const CeedInt nelem = user->melem[0]*user->melem[1]*user->melem[2],
+                  P = user->P;
+    CeedScalar *ue;
+    CeedVectorCreate(user->ceed, user->ncomp*nelem*P*P*P, &u);
+    CeedVectorGetArray(u, CEED_MEM_HOST, &ue);
+    StructuredRestrict(user->melem, P, user->ncomp, user->lsize, 0, nelem, x,
+                       ue);
+    CeedVectorRestoreArray(u, &ue);
+  } else {
+    CeedVectorSetArray(u, CEED_MEM_HOST, CEED_USE_POINTER, x);
+  }
+  CeedOperatorApply(op_error, u, collocated_error, CEED_REQUEST_IMMEDIATE);
   VecRestoreArrayRead(user->Xloc, (const PetscScalar**)&x); CHKERRQ(ierr);
+  if (user->structured) CeedVectorDestroy(&u);
 
   *maxerror = 0;
   const CeedScalar *e;
@@ -172,30 +838,542 @@ static PetscErrorCode ComputeErrorMax(User user, CeedOperator op_error, Vec X,
     *maxerror = PetscMax(*maxerror, PetscAbsScalar(e[i]));
   }
   CeedVectorRestoreArrayRead(collocated_error, &e);
-  ierr = MPI_Allreduce(MPI_IN_PLACE, &maxerror,
-                       1, MPIU_SCALAR, MPIU_MAX, user->comm); CHKERRQ(ierr);
+  ierr = MPI_Allreduce(MPI_IN_PLACE, maxerror,
+                       1, MPIU_REAL, MPIU_MAX, user->comm); CHKERRQ(ierr);
   CeedVectorDestroy(&collocated_error);
   PetscFunctionReturn(0);
 }
 
+// The libCEED objects of one backend (CEED resource). The element
+// restrictions of all backends are built from the same index arrays.
+typedef struct CeedData_ *CeedData;
+struct CeedData_ {
+  Ceed ceed;
+  CeedBasis basisx, basisu;
+  CeedElemRestriction Erestrictx, Erestrictu, Erestrictxi, Erestrictui,
+                      Erestrictqdi;
+  CeedElemRestriction Erestrictu_int, Erestrictu_bdry, Erestrictq_int,
+                      Erestrictq_bdry;
+  // Used with -overlap: the output restriction of the process-boundary
+  // elements, into the vector of the nodes of these elements
+  CeedElemRestriction Erestrictv_bdry;
+  CeedQFunction qf_setup, qf_apply, qf_error;
+  CeedOperator op_setup, op_apply, op_error, op_apply_int, op_apply_bdry;
+  CeedVector qdata, target, xceed, yceed, ybceed;
+  // Used with -onthefly: the node coordinates, read by the mass operator
+  CeedVector xcoord;
+  // Used with -structured: the identity restrictions of one batch of
+  // elements, the quadrature data input of the batch operator op_apply, and
+  // the quadrature data of all local elements, stored batch by batch
+  CeedElemRestriction Erestrictu_batch, Erestrictq_batch;
+  CeedVector qbatch;
+  CeedScalar *qdbatches;
+};
+
+// Create the libCEED objects for the given resource, compute the quadrature
+// data and the true solution, and the local right-hand side in rhsloc. With
+// -overlap, bnodeloc gives the local node of each of the nbnode nodes of the
+// process-boundary elements.
+static PetscErrorCode SetupCeedData(const char *resource, const BPData *bp,
+                                    PetscInt degree, PetscInt qextra,
+                                    const PetscInt melem[3],
+                                    const PetscInt p[3],
+                                    const PetscInt irank[3],
+                                    const bool ghostdir[3], PetscBool overlap,
+                                    PetscBool structured, PetscBool onthefly,
+                                    PetscInt lsize, PetscInt nbnode,
+                                    const PetscInt *bnodeloc, Vec rhsloc,
+                                    CeedData data) {
+  PetscErrorCode ierr;
+  Ceed ceed;
+  CeedInt P, Q, ncomp = bp->ncomp;
+  CeedQuadMode qmode;
+  CeedEvalMode emode;
+  CeedVector xcoord, rhsceed;
+  PetscScalar *r;
+
+  PetscFunctionBeginUser;
+  ierr = PetscMemzero(data, sizeof(*data)); CHKERRQ(ierr);
+  CeedInit(resource, &data->ceed);
+  ceed = data->ceed;
+  P = degree + 1;
+  Q = bp->collocated ? P : P + qextra;
+  qmode = bp->collocated ? CEED_GAUSS_LOBATTO : CEED_GAUSS;
+  emode = bp->diffusion ? CEED_EVAL_GRAD : CEED_EVAL_INTERP;
+  CeedBasisCreateTensorH1Lagrange(ceed, 3, ncomp, P, Q, qmode, &data->basisu);
+  CeedBasisCreateTensorH1Lagrange(ceed, 3, 3, 2, Q, qmode, &data->basisx);
+
+  CeedInt nelem = melem[0]*melem[1]*melem[2];
+  // With -structured, the operators act on element vectors, restricted by
+  // StructuredRestrict, and the solution space has an identity restriction;
+  // the setup and error operators, applied once, act on all local elements,
+  // and the mass or diffusion operator on one batch of nb elements
+  const CeedInt nb = structured ? StructuredBatchSize(melem, P, ncomp) : 0;
+  ierr = PetscLogStagePush(stage_restriction); CHKERRQ(ierr);
+  if (structured) {
+    CeedElemRestrictionCreateIdentity(ceed, nelem, P*P*P, nelem*P*P*P, ncomp,
+                                      &data->Erestrictu);
+    CeedElemRestrictionCreateIdentity(ceed, nb, P*P*P, nb*P*P*P, ncomp,
+                                      &data->Erestrictu_batch);
+    CeedElemRestrictionCreateIdentity(ceed, nb, Q*Q*Q, nb*Q*Q*Q,
+                                      bp->qdatasize, &data->Erestrictq_batch);
+  } else {
+    CreateRestriction(ceed, melem, P, ncomp, ghostdir, ELEM_ALL,
+                      &data->Erestrictu);
+  }
+  CreateRestriction(ceed, melem, 2, 3, ghostdir, ELEM_ALL, &data->Erestrictx);
+  // Size of the vectors used with Erestrictu, and of the input and output of
+  // the mass or diffusion operator
+  const CeedInt usize = structured ? ncomp*nelem*P*P*P : ncomp*lsize,
+                xsize = structured ? ncomp*nb*P*P*P : ncomp*lsize;
+  CeedElemRestrictionCreateIdentity(ceed, nelem, Q*Q*Q, nelem*Q*Q*Q, ncomp,
+                                    &data->Erestrictui);
+  CeedElemRestrictionCreateIdentity(ceed, nelem, Q*Q*Q, nelem*Q*Q*Q,
+                                    bp->qdatasize, &data->Erestrictqdi);
+  CeedElemRestrictionCreateIdentity(ceed, nelem, Q*Q*Q, nelem*Q*Q*Q, 1,
+                                    &data->Erestrictxi);
+  ierr = PetscLogStagePop(); CHKERRQ(ierr);
+  {
+    CeedScalar *xloc;
+    CeedInt shape[3] = {melem[0]+1, melem[1]+1, melem[2]+1}, len =
+                         shape[0]*shape[1]*shape[2];
+    xloc = malloc(len*3*sizeof xloc[0]);
+    for (CeedInt i=0; i<shape[0]; i++) {
+      for (CeedInt j=0; j<shape[1]; j++) {
+        for (CeedInt k=0; k<shape[2]; k++) {
+          xloc[((i*shape[1]+j)*shape[2]+k) + 0*len] = 1.*(irank[0]*melem[0]+i) /
+              (p[0]*melem[0]);
+          xloc[((i*shape[1]+j)*shape[2]+k) + 1*len] = 1.*(irank[1]*melem[1]+j) /
+              (p[1]*melem[1]);
+          xloc[((i*shape[1]+j)*shape[2]+k) + 2*len] = 1.*(irank[2]*melem[2]+k) /
+              (p[2]*melem[2]);
+        }
+      }
+    }
+    CeedVectorCreate(ceed, len*3, &xcoord);
+    CeedVectorSetArray(xcoord, CEED_MEM_HOST, CEED_OWN_POINTER, xloc);
+  }
+
+  // Create the Q-function that builds the operator (i.e. computes its
+  // quadrature data), the true solution and the right-hand side, and set its
+  // context data.
+  CeedQFunctionCreateInterior(ceed, 1,
+                              bp->setup, bp->setupname, &data->qf_setup);
+  CeedQFunctionAddInput(data->qf_setup, "x", 3, CEED_EVAL_INTERP);
+  CeedQFunctionAddInput(data->qf_setup, "dx", 3, CEED_EVAL_GRAD);
+  CeedQFunctionAddInput(data->qf_setup, "weight", 1, CEED_EVAL_WEIGHT);
+  CeedQFunctionAddOutput(data->qf_setup, "qdata", bp->qdatasize,
+                         CEED_EVAL_NONE);
+  CeedQFunctionAddOutput(data->qf_setup, "true_soln", ncomp, CEED_EVAL_NONE);
+  CeedQFunctionAddOutput(data->qf_setup, "rhs", ncomp, CEED_EVAL_INTERP);
+  CeedQFunctionSetContext(data->qf_setup, (void *)&bp->ncomp,
+                          sizeof bp->ncomp);
+
+  // Create the Q-function that defines the action of the operator. With
+  // -onthefly, the mass operator computes its quadrature data from the
+  // coordinates instead of reading it.
+  if (onthefly) {
+    CeedQFunctionCreateInterior(ceed, 1, MassOnTheFly,
+                                __FILE__ ":MassOnTheFly", &data->qf_apply);
+    CeedQFunctionAddInput(data->qf_apply, "u", ncomp, CEED_EVAL_INTERP);
+    CeedQFunctionAddInput(data->qf_apply, "dx", 3, CEED_EVAL_GRAD);
+    CeedQFunctionAddInput(data->qf_apply, "weight", 1, CEED_EVAL_WEIGHT);
+    CeedQFunctionAddOutput(data->qf_apply, "v", ncomp, CEED_EVAL_INTERP);
+    CeedQFunctionSetContext(data->qf_apply, (void *)&bp->ncomp,
+                            sizeof bp->ncomp);
+  } else {
+    CeedQFunctionCreateInterior(ceed, 1,
+                                bp->apply, bp->applyname, &data->qf_apply);
+    CeedQFunctionAddInput(data->qf_apply, "u", ncomp, emode);
+    CeedQFunctionAddInput(data->qf_apply, "qdata", bp->qdatasize,
+                          CEED_EVAL_NONE);
+    CeedQFunctionAddOutput(data->qf_apply, "v", ncomp, emode);
+  }
+
+  // Create the error qfunction
+  CeedQFunctionCreateInterior(ceed, 1,
+                              Error, __FILE__ ":Error", &data->qf_error);
+  CeedQFunctionAddInput(data->qf_error, "u", ncomp, CEED_EVAL_INTERP);
+  CeedQFunctionAddInput(data->qf_error, "true_soln", ncomp, CEED_EVAL_NONE);
+  CeedQFunctionAddOutput(data->qf_error, "error", ncomp, CEED_EVAL_NONE);
+  CeedQFunctionSetContext(data->qf_error, (void *)&bp->ncomp,
+                          sizeof bp->ncomp);
+
+  // Create the persistent vectors that will be needed in setup
+  CeedInt Nqpts;
+  CeedBasisGetNumQuadraturePoints(data->basisu, &Nqpts);
+  CeedVectorCreate(ceed, nelem*Nqpts*bp->qdatasize, &data->qdata);
+  CeedVectorCreate(ceed, nelem*Nqpts*ncomp, &data->target);
+  CeedVectorCreate(ceed, usize, &rhsceed);
+  CeedVectorCreate(ceed, xsize, &data->xceed);
+  CeedVectorCreate(ceed, xsize, &data->yceed);
+
+  // Create the operator that builds the quadrature data for the operator.
+  CeedOperatorCreate(ceed, data->qf_setup, NULL, NULL, &data->op_setup);
+  CeedOperatorSetField(data->op_setup, "x", data->Erestrictx, data->basisx,
+                       CEED_VECTOR_ACTIVE);
+  CeedOperatorSetField(data->op_setup, "dx", data->Erestrictx, data->basisx,
+                       CEED_VECTOR_ACTIVE);
+  CeedOperatorSetField(data->op_setup, "weight", data->Erestrictxi,
+                       data->basisx, CEED_VECTOR_NONE);
+  CeedOperatorSetField(data->op_setup, "qdata", data->Erestrictqdi,
+                       CEED_BASIS_COLLOCATED, CEED_VECTOR_ACTIVE);
+  CeedOperatorSetField(data->op_setup, "true_soln", data->Erestrictui,
+                       CEED_BASIS_COLLOCATED, data->target);
+  CeedOperatorSetField(data->op_setup, "rhs", data->Erestrictu, data->basisu,
+                       rhsceed);
+
+  // Create the mass or diffusion operator.
+  CeedOperatorCreate(ceed, data->qf_apply, NULL, NULL, &data->op_apply);
+  if (structured) {
+    CeedVectorCreate(ceed, nb*Nqpts*bp->qdatasize, &data->qbatch);
+    CeedOperatorSetField(data->op_apply, "u", data->Erestrictu_batch,
+                         data->basisu, CEED_VECTOR_ACTIVE);
+    CeedOperatorSetField(data->op_apply, "qdata", data->Erestrictq_batch,
+                         CEED_BASIS_COLLOCATED, data->qbatch);
+    CeedOperatorSetField(data->op_apply, "v", data->Erestrictu_batch,
+                         data->basisu, CEED_VECTOR_ACTIVE);
+  } else {
+    CeedOperatorSetField(data->op_apply, "u", data->Erestrictu, data->basisu,
+                         CEED_VECTOR_ACTIVE);
+    if (onthefly) {
+      CeedOperatorSetField(data->op_apply, "dx", data->Erestrictx,
+                           data->basisx, xcoord);
+      CeedOperatorSetField(data->op_apply, "weight", data->Erestrictxi,
+                           data->basisx, CEED_VECTOR_NONE);
+    } else {
+      CeedOperatorSetField(data->op_apply, "qdata", data->Erestrictqdi,
+                           CEED_BASIS_COLLOCATED, data->qdata);
+    }
+    CeedOperatorSetField(data->op_apply, "v", data->Erestrictu, data->basisu,
+                         CEED_VECTOR_ACTIVE);
+  }
+
+  // Create the operators on the interior and on the process-boundary
+  // elements, used by MatMult_CeedOverlap
+  if (overlap) {
+    ierr = PetscLogStagePush(stage_restriction); CHKERRQ(ierr);
+    CreateRestriction(ceed, melem, P, ncomp, ghostdir, ELEM_INTERIOR,
+                      &data->Erestrictu_int);
+    CreateRestriction(ceed, melem, P, ncomp, ghostdir, ELEM_BOUNDARY,
+                      &data->Erestrictu_bdry);
+    {
+      PetscInt *bnodemap;
+      ierr = PetscMalloc1(lsize, &bnodemap); CHKERRQ(ierr);
+      for (PetscInt b=0; b<nbnode; b++) bnodemap[bnodeloc[b]] = b;
+      CreateMappedRestriction(ceed, melem, P, ncomp, ghostdir, ELEM_BOUNDARY,
+                              nbnode, bnodemap, &data->Erestrictv_bdry);
+      ierr = PetscFree(bnodemap); CHKERRQ(ierr);
+    }
+    CreateQDataRestriction(ceed, melem, Nqpts, bp->qdatasize, ghostdir,
+                           ELEM_INTERIOR, &data->Erestrictq_int);
+    CreateQDataRestriction(ceed, melem, Nqpts, bp->qdatasize, ghostdir,
+                           ELEM_BOUNDARY, &data->Erestrictq_bdry);
+    ierr = PetscLogStagePop(); CHKERRQ(ierr);
+    CeedOperatorCreate(ceed, data->qf_apply, NULL, NULL, &data->op_apply_int);
+    CeedOperatorSetField(data->op_apply_int, "u", data->Erestrictu_int,
+                         data->basisu, CEED_VECTOR_ACTIVE);
+    CeedOperatorSetField(data->op_apply_int, "qdata", data->Erestrictq_int,
+                         CEED_BASIS_COLLOCATED, data->qdata);
+    CeedOperatorSetField(data->op_apply_int, "v", data->Erestrictu_int,
+                         data->basisu, CEED_VECTOR_ACTIVE);
+    CeedOperatorCreate(ceed, data->qf_apply, NULL, NULL, &data->op_apply_bdry);
+    CeedOperatorSetField(data->op_apply_bdry, "u", data->Erestrictu_bdry,
+                         data->basisu, CEED_VECTOR_ACTIVE);
+    CeedOperatorSetField(data->op_apply_bdry, "qdata", data->Erestrictq_bdry,
+                         CEED_BASIS_COLLOCATED, data->qdata);
+    CeedOperatorSetField(data->op_apply_bdry, "v", data->Erestrictv_bdry,
+                         data->basisu, CEED_VECTOR_ACTIVE);
+    CeedVectorCreate(ceed, ncomp*nbnode, &data->ybceed);
+  }
+
+  // Create the error operator
+  CeedOperatorCreate(ceed, data->qf_error, NULL, NULL, &data->op_error);
+  CeedOperatorSetField(data->op_error, "u", data->Erestrictu, data->basisu,
+                       CEED_VECTOR_ACTIVE);
+  CeedOperatorSetField(data->op_error, "true_soln", data->Erestrictui,
+                       CEED_BASIS_COLLOCATED, data->target);
+  CeedOperatorSetField(data->op_error, "error", data->Erestrictui,
+                       CEED_BASIS_COLLOCATED, CEED_VECTOR_ACTIVE);
+
+  // Setup qdata, rhs, and target
+  ierr = PetscLogStagePush(stage_qfunction); CHKERRQ(ierr);
+  ierr = VecZeroEntries(rhsloc); CHKERRQ(ierr);
+  ierr = VecGetArray(rhsloc, &r); CHKERRQ(ierr);
+  if (!structured)
+    CeedVectorSetArray(rhsceed, CEED_MEM_HOST, CEED_USE_POINTER, r);
+  CeedOperatorApply(data->op_setup, xcoord, data->qdata,
+                    CEED_REQUEST_IMMEDIATE);
+  if (structured) {
+    const CeedScalar *re;
+    CeedVectorGetArrayRead(rhsceed, CEED_MEM_HOST, &re);
+    StructuredRestrictTranspose(melem, P, ncomp, lsize, 0, nelem, re, r);
+    CeedVectorRestoreArrayRead(rhsceed, &re);
+  }
+  ierr = VecRestoreArray(rhsloc, &r); CHKERRQ(ierr);
+  ierr = PetscLogStagePop(); CHKERRQ(ierr);
+  if (structured) {
+    // The quadrature data is stored as [qdatasize][nelem][Nqpts]; reorder it
+    // as [nelem/nb][qdatasize][nb][Nqpts], so that the quadrature data of
+    // each batch is contiguous
+    const CeedInt qdatasize = bp->qdatasize;
+    const CeedScalar *qd;
+    ierr = PetscMalloc1(qdatasize*nelem*Nqpts, &data->qdbatches);
+    CHKERRQ(ierr);
+    CeedVectorGetArrayRead(data->qdata, CEED_MEM_HOST, &qd);
+    for (CeedInt c=0; c<qdatasize; c++)
+      for (CeedInt e=0; e<nelem; e++)
+        for (CeedInt q=0; q<Nqpts; q++)
+          data->qdbatches[((e/nb*qdatasize + c)*nb + e%nb)*Nqpts + q] =
+            qd[(c*nelem + e)*Nqpts + q];
+    CeedVectorRestoreArrayRead(data->qdata, &qd);
+    CeedVectorDestroy(&data->qdata);
+  }
+  if (onthefly) {
+    // Only the coordinates are kept for the operator
+    CeedVectorDestroy(&data->qdata);
+    data->xcoord = xcoord;
+  } else {
+    CeedVectorDestroy(&xcoord);
+  }
+  CeedVectorDestroy(&rhsceed);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode DestroyCeedData(CeedData data, PetscBool overlap) {
+  PetscErrorCode ierr;
+
+  PetscFunctionBeginUser;
+  if (overlap) {
+    CeedVectorDestroy(&data->ybceed);
+    CeedOperatorDestroy(&data->op_apply_int);
+    CeedOperatorDestroy(&data->op_apply_bdry);
+    CeedElemRestrictionDestroy(&data->Erestrictu_int);
+    CeedElemRestrictionDestroy(&data->Erestrictu_bdry);
+    CeedElemRestrictionDestroy(&data->Erestrictv_bdry);
+    CeedElemRestrictionDestroy(&data->Erestrictq_int);
+    CeedElemRestrictionDestroy(&data->Erestrictq_bdry);
+  }
+  CeedVectorDestroy(&data->xceed);
+  CeedVectorDestroy(&data->yceed);
+  CeedVectorDestroy(&data->qdata);
+  CeedVectorDestroy(&data->qbatch);
+  ierr = PetscFree(data->qdbatches); CHKERRQ(ierr);
+  CeedElemRestrictionDestroy(&data->Erestrictu_batch);
+  CeedElemRestrictionDestroy(&data->Erestrictq_batch);
+  CeedVectorDestroy(&data->xcoord);
+  CeedVectorDestroy(&data->target);
+  CeedOperatorDestroy(&data->op_setup);
+  CeedOperatorDestroy(&data->op_apply);
+  CeedOperatorDestroy(&data->op_error);
+  CeedElemRestrictionDestroy(&data->Erestrictu);
+  CeedElemRestrictionDestroy(&data->Erestrictx);
+  CeedElemRestrictionDestroy(&data->Erestrictui);
+  CeedElemRestrictionDestroy(&data->Erestrictqdi);
+  CeedElemRestrictionDestroy(&data->Erestrictxi);
+  CeedQFunctionDestroy(&data->qf_setup);
+  CeedQFunctionDestroy(&data->qf_apply);
+  CeedQFunctionDestroy(&data->qf_error);
+  CeedBasisDestroy(&data->basisu);
+  CeedBasisDestroy(&data->basisx);
+  CeedDestroy(&data->ceed);
+  PetscFunctionReturn(0);
+}
+
+// Create the per-thread operators for the slabs of elements [i0,i1) x melem[1]
+// x melem[2], with i0 = t*melem[0]/nthreads, and copy their quadrature data
+// from the quadrature data of all local elements.
+static PetscErrorCode SetupThreadOps(const char *resource, const BPData *bp,
+                                     PetscInt degree, PetscInt qextra,
+                                     const PetscInt melem[3],
+                                     PetscInt nthreads, CeedVector qdata,
+                                     ThreadOp *tops) {
+  PetscErrorCode ierr;
+  const bool noghost[3] = {false, false, false};
+  const CeedInt ncomp = bp->ncomp, P = degree + 1,
+                Q = bp->collocated ? P : P + qextra, Q3 = Q*Q*Q,
+                nelem = melem[0]*melem[1]*melem[2];
+  const PetscInt plane = (melem[1]*degree + 1)*(melem[2]*degree + 1);
+  const CeedQuadMode qmode = bp->collocated ? CEED_GAUSS_LOBATTO : CEED_GAUSS;
+  const CeedEvalMode emode = bp->diffusion ? CEED_EVAL_GRAD : CEED_EVAL_INTERP;
+  const CeedScalar *qd;
+
+  PetscFunctionBeginUser;
+  CeedVectorGetArrayRead(qdata, CEED_MEM_HOST, &qd);
+  for (PetscInt t=0; t<nthreads; t++) {
+    ThreadOp *top = &tops[t];
+    const PetscInt i0 = t*melem[0]/nthreads, i1 = (t+1)*melem[0]/nthreads;
+    const PetscInt smelem[3] = {i1 - i0, melem[1], melem[2]};
+    const CeedInt snelem = smelem[0]*smelem[1]*smelem[2],
+                  e0 = i0*melem[1]*melem[2];
+    CeedScalar *sqd;
+
+    top->offset = i0*degree*plane;
+    top->size = ((i1 - i0)*degree + 1)*plane;
+    CeedInit(resource, &top->ceed);
+    CeedBasisCreateTensorH1Lagrange(top->ceed, 3, ncomp, P, Q, qmode,
+                                    &top->basisu);
+    CreateRestriction(top->ceed, smelem, P, ncomp, noghost, ELEM_ALL,
+                      &top->Erestrictu);
+    CeedElemRestrictionCreateIdentity(top->ceed, snelem, Q3, snelem*Q3,
+                                      bp->qdatasize, &top->Erestrictqdi);
+    // The quadrature data is stored as [qdatasize][nelem][Q3]
+    ierr = PetscMalloc1(bp->qdatasize*snelem*Q3, &sqd); CHKERRQ(ierr);
+    for (CeedInt c=0; c<bp->qdatasize; c++)
+      for (CeedInt e=0; e<snelem; e++)
+        for (CeedInt q=0; q<Q3; q++)
+          sqd[(c*snelem + e)*Q3 + q] = qd[(c*nelem + e0 + e)*Q3 + q];
+    CeedVectorCreate(top->ceed, bp->qdatasize*snelem*Q3, &top->qdata);
+    CeedVectorSetArray(top->qdata, CEED_MEM_HOST, CEED_COPY_VALUES, sqd);
+    ierr = PetscFree(sqd); CHKERRQ(ierr);
+
+    CeedQFunctionCreateInterior(top->ceed, 1,
+                                bp->apply, bp->applyname, &top->qf_apply);
+    CeedQFunctionAddInput(top->qf_apply, "u", ncomp, emode);
+    CeedQFunctionAddInput(top->qf_apply, "qdata", bp->qdatasize,
+                          CEED_EVAL_NONE);
+    CeedQFunctionAddOutput(top->qf_apply, "v", ncomp, emode);
+    CeedOperatorCreate(top->ceed, top->qf_apply, NULL, NULL, &top->op_apply);
+    CeedOperatorSetField(top->op_apply, "u", top->Erestrictu, top->basisu,
+                         CEED_VECTOR_ACTIVE);
+    CeedOperatorSetField(top->op_apply, "qdata", top->Erestrictqdi,
+                         CEED_BASIS_COLLOCATED, top->qdata);
+    CeedOperatorSetField(top->op_apply, "v", top->Erestrictu, top->basisu,
+                         CEED_VECTOR_ACTIVE);
+
+    // With one component, ApplyThreaded binds xceed to the local input
+    top->x = NULL;
+    if (ncomp > 1) {
+      ierr = PetscMalloc1(ncomp*top->size, &top->x); CHKERRQ(ierr);
+    }
+    ierr = PetscMalloc1(ncomp*top->size, &top->y); CHKERRQ(ierr);
+    CeedVectorCreate(top->ceed, ncomp*top->size, &top->xceed);
+    CeedVectorCreate(top->ceed, ncomp*top->size, &top->yceed);
+    if (top->x)
+      CeedVectorSetArray(top->xceed, CEED_MEM_HOST, CEED_USE_POINTER, top->x);
+    CeedVectorSetArray(top->yceed, CEED_MEM_HOST, CEED_USE_POINTER, top->y);
+  }
+  CeedVectorRestoreArrayRead(qdata, &qd);
+  PetscFunctionReturn(0);
+}
+
+static PetscErrorCode DestroyThreadOps(PetscInt nthreads, ThreadOp *tops) {
+  PetscErrorCode ierr;
+
+  PetscFunctionBeginUser;
+  for (PetscInt t=0; t<nthreads; t++) {
+    ThreadOp *top = &tops[t];
+    CeedVectorDestroy(&top->xceed);
+    CeedVectorDestroy(&top->yceed);
+    CeedVectorDestroy(&top->qdata);
+    CeedOperatorDestroy(&top->op_apply);
+    CeedQFunctionDestroy(&top->qf_apply);
+    CeedElemRestrictionDestroy(&top->Erestrictu);
+    CeedElemRestrictionDestroy(&top->Erestrictqdi);
+    CeedBasisDestroy(&top->basisu);
+    CeedDestroy(&top->ceed);
+    ierr = PetscFree(top->x); CHKERRQ(ierr);
+    ierr = PetscFree(top->y); CHKERRQ(ierr);
+  }
+  PetscFunctionReturn(0);
+}
+
+// Point the shell matrix context to the libCEED objects of one backend
+static void UserSetCeedData(User user, CeedData data) {
+  user->ceed = data->ceed;
+  user->op = data->op_apply;
+  user->qdata = data->qdata;
+  user->xceed = data->xceed;
+  user->yceed = data->yceed;
+  user->op_interior = data->op_apply_int;
+  user->op_boundary = data->op_apply_bdry;
+  user->ybceed = data->ybceed;
+  user->qbatch = data->qbatch;
+  user->qdbatches = data->qdbatches;
+  user->num_mult = 0;
+  user->wait_time = 0.;
+  user->diag_valid = PETSC_FALSE;
+  if (user->bound) {
+    CeedVectorSetArray(user->xceed, CEED_MEM_HOST, CEED_USE_POINTER,
+                       user->xloc);
+    CeedVectorSetArray(user->yceed, CEED_MEM_HOST, CEED_USE_POINTER,
+                       user->yloc);
+    if (user->ybceed)
+      CeedVectorSetArray(user->ybceed, CEED_MEM_HOST, CEED_USE_POINTER,
+                         user->ybloc);
+  }
+}
+
+// Create the CG solver, preconditioned with Jacobi, or with a fixed number of
+// Chebyshev iterations preconditioned with Jacobi, using the diagonal of the
+// operator
+static PetscErrorCode CreateSolver(MPI_Comm comm, Mat mat, PetscInt precond,
+                                   PetscInt chebyshev_its, KSP *ksp) {
+  PetscErrorCode ierr;
+  PC pc;
+
+  PetscFunctionBeginUser;
+  ierr = KSPCreate(comm, ksp); CHKERRQ(ierr);
+  ierr = KSPSetType(*ksp, KSPCG); CHKERRQ(ierr);
+  ierr = KSPSetTolerances(*ksp, 1e-10, PETSC_DEFAULT, PETSC_DEFAULT,
+                          PETSC_DEFAULT); CHKERRQ(ierr);
+  ierr = KSPSetOperators(*ksp, mat, mat); CHKERRQ(ierr);
+  ierr = KSPGetPC(*ksp, &pc); CHKERRQ(ierr);
+  switch (precond) {
+  case PRECOND_NONE:
+    ierr = PCSetType(pc, PCNONE); CHKERRQ(ierr);
+    break;
+  case PRECOND_JACOBI:
+    ierr = PCSetType(pc, PCJACOBI); CHKERRQ(ierr);
+    break;
+  case PRECOND_CHEBYSHEV: {
+    KSP kspcheb;
+    PC pccheb;
+    // A fixed number of iterations with fixed eigenvalue bounds, estimated
+    // once at setup, is a fixed SPD operator, as required by CG
+    ierr = PCSetType(pc, PCKSP); CHKERRQ(ierr);
+    ierr = PCKSPGetKSP(pc, &kspcheb); CHKERRQ(ierr);
+    ierr = KSPSetType(kspcheb, KSPCHEBYSHEV); CHKERRQ(ierr);
+    ierr = KSPChebyshevEstEigSet(kspcheb, 0, 0.1, 0, 1.1); CHKERRQ(ierr);
+    ierr = KSPSetTolerances(kspcheb, 0, 0, PETSC_DEFAULT, chebyshev_its);
+    CHKERRQ(ierr);
+    ierr = KSPSetNormType(kspcheb, KSP_NORM_NONE); CHKERRQ(ierr);
+    ierr = KSPGetPC(kspcheb, &pccheb); CHKERRQ(ierr);
+    ierr = PCSetType(pccheb, PCJACOBI); CHKERRQ(ierr);
+  } break;
+  }
+  PetscFunctionReturn(0);
+}
+
 int main(int argc, char **argv) {
   PetscInt ierr;
   MPI_Comm comm;
   char ceedresource[4096] = "/cpu/self";
   PetscInt degree, qextra, localdof, localelem, melem[3], mdof[3], p[3],
-           irank[3], ldof[3], lsize;
+           irank[3], ldof[3], lsize, problem;
   PetscScalar *r;
-  PetscBool test_mode;
+  PetscBool test_mode, overlap, bind, structured, onthefly,
+            ceed_list = PETSC_FALSE;
   PetscMPIInt size, rank;
-  VecScatter ltog;
-  Ceed ceed;
-  CeedBasis basisx, basisu;
-  CeedElemRestriction Erestrictx, Erestrictu, Erestrictxi, Erestrictui;
-  CeedQFunction qf_setup, qf_mass, qf_error;
-  CeedOperator op_setup, op_mass, op_error;
-  CeedVector xcoord, rho, rhsceed, target;
-  CeedInt P, Q;
-  Vec X, Xloc, rhs, rhsloc;
+  VecScatter ltog, ghost = NULL;
+  VecScatter bghost = NULL;
+  PetscInt nowned, *ownedloc = NULL, nbnode = 0, *bnodeloc = NULL,
+                   *bnodeown = NULL;
+  PetscScalar *xlocarray = NULL, *ylocarray = NULL, *yblocarray = NULL;
+  PetscInt nbcloc = 0, *bcloc = NULL, nbcown = 0, *bcown = NULL;
+  bool ghostdir[3];
+  const BPData *bp;
+  char *backends[MAX_BACKENDS];
+  PetscInt nbackends, nmult, nthreads, precond, chebyshev_its,
+           nfailed = 0;
+  PetscReal backend_tol;
+  struct {
+    double apply_time, solve_time;
+    PetscInt its;
+    PetscReal diff;
+  } stats[MAX_BACKENDS];
+  CeedInt ncomp;
+  Vec X, Xloc, Ybloc = NULL, rhs, rhsloc, X0, Y0, Y;
   Mat mat;
   KSP ksp;
   User user;
@@ -204,7 +1382,11 @@ int main(int argc, char **argv) {
   ierr = PetscInitialize(&argc, &argv, NULL, help);
   if (ierr) return ierr;
   comm = PETSC_COMM_WORLD;
-  ierr = PetscOptionsBegin(comm, NULL, "CEED BP1 in PETSc", NULL); CHKERRQ(ierr);
+  ierr = RegisterLogging(); CHKERRQ(ierr);
+  ierr = PetscOptionsBegin(comm, NULL, "CEED BPs in PETSc", NULL); CHKERRQ(ierr);
+  problem = 1;
+  ierr = PetscOptionsInt("-problem", "CEED benchmark problem to solve (1-6)",
+                         NULL, problem, &problem, NULL); CHKERRQ(ierr);
   test_mode = PETSC_FALSE;
   ierr = PetscOptionsBool("-test",
                           "Testing mode (do not print unless error is large)",
@@ -213,7 +1395,8 @@ int main(int argc, char **argv) {
   ierr = PetscOptionsInt("-degree", "Polynomial degree of tensor product basis",
                          NULL, degree, &degree, NULL); CHKERRQ(ierr);
   qextra = 2;
-  ierr = PetscOptionsInt("-qextra", "Number of extra quadrature points",
+  ierr = PetscOptionsInt("-qextra", "Number of extra quadrature points "
+                         "(not used by the collocated BP5 and BP6)",
                          NULL, qextra, &qextra, NULL); CHKERRQ(ierr);
   ierr = PetscOptionsString("-ceed", "CEED resource specifier",
                             NULL, ceedresource, ceedresource,
@@ -222,18 +1405,84 @@ int main(int argc, char **argv) {
   ierr = PetscOptionsInt("-local",
                          "Target number of locally owned degrees of freedom per process",
                          NULL, localdof, &localdof, NULL); CHKERRQ(ierr);
+  overlap = PETSC_FALSE;
+  ierr = PetscOptionsBool("-overlap",
+                          "Overlap the communication in MatMult with the "
+                          "interior elements",
+                          NULL, overlap, &overlap, NULL); CHKERRQ(ierr);
+  bind = PETSC_FALSE;
+  ierr = PetscOptionsBool("-bind",
+                          "Bind the local vectors to the CeedVectors once "
+                          "at setup (CPU backends only)",
+                          NULL, bind, &bind, NULL); CHKERRQ(ierr);
+  structured = PETSC_FALSE;
+  ierr = PetscOptionsBool("-structured",
+                          "Use the structured element restriction of the box "
+                          "mesh, without an index array",
+                          NULL, structured, &structured, NULL); CHKERRQ(ierr);
+  onthefly = PETSC_FALSE;
+  ierr = PetscOptionsBool("-onthefly",
+                          "Compute the geometric factors of the mass operator "
+                          "in each application instead of storing them",
+                          NULL, onthefly, &onthefly, NULL); CHKERRQ(ierr);
+  nthreads = 1;
+  ierr = PetscOptionsInt("-threads", "Number of OpenMP threads applying "
+                         "per-thread operators on slabs of local elements",
+                         NULL, nthreads, &nthreads, NULL); CHKERRQ(ierr);
+  precond = PRECOND_NONE;
+  ierr = PetscOptionsEList("-preconditioner", "Preconditioner of the CG solve, "
+                           "using the diagonal of the operator", NULL,
+                           precondtypes, 3, precondtypes[precond], &precond,
+                           NULL); CHKERRQ(ierr);
+  chebyshev_its = 3;
+  ierr = PetscOptionsInt("-chebyshev_its", "Number of Chebyshev-Jacobi "
+                         "iterations per application of the preconditioner",
+                         NULL, chebyshev_its, &chebyshev_its, NULL);
+  CHKERRQ(ierr);
+  nbackends = MAX_BACKENDS;
+  ierr = PetscOptionsStringArray("-ceed_list", "Comma-separated list of CEED "
+                                 "resources to compare on the same mesh",
+                                 NULL, backends, &nbackends, &ceed_list);
+  CHKERRQ(ierr);
+  nmult = 0;
+  ierr = PetscOptionsInt("-nmult", "Number of timed operator applies "
+                         "per backend", NULL, nmult, &nmult, NULL);
+  CHKERRQ(ierr);
+  backend_tol = 1e-6;
+  ierr = PetscOptionsReal("-backend_tol", "Tolerance for the relative "
+                          "difference from the first backend in -ceed_list",
+                          NULL, backend_tol, &backend_tol, NULL); CHKERRQ(ierr);
   ierr = PetscOptionsEnd(); CHKERRQ(ierr);
+  if (!ceed_list || nbackends == 0) {
+    nbackends = 1;
+    ierr = PetscStrallocpy(ceedresource, &backends[0]); CHKERRQ(ierr);
+  }
+  if (problem < 1 || problem > 6)
+    SETERRQ1(comm, PETSC_ERR_ARG_OUTOFRANGE, "Invalid problem: %D", problem);
+  if (structured && (overlap || bind || onthefly))
+    SETERRQ(comm, PETSC_ERR_ARG_INCOMP,
+            "-structured cannot be combined with -overlap, -bind or -onthefly");
+  if (onthefly && (bpdata[problem-1].diffusion || overlap))
+    SETERRQ(comm, PETSC_ERR_ARG_INCOMP,
+            "-onthefly is only available for BP1 and BP2, without -overlap");
+  if (nthreads > 1 && (overlap || bind || structured || onthefly))
+    SETERRQ(comm, PETSC_ERR_ARG_INCOMP, "-threads cannot be combined with "
+            "-overlap, -bind, -structured or -onthefly");
+  bp = &bpdata[problem-1];
+  ncomp = bp->ncomp;
 
   // Determine size of process grid
   ierr = MPI_Comm_size(comm, &size); CHKERRQ(ierr);
   Split3(size, p, false);
 
   // Find a nicely composite number of elements no less than localdof
-  for (localelem = PetscMax(1, localdof / (degree*degree*degree)); ;
+  for (localelem = PetscMax(1, localdof / (ncomp*degree*degree*degree)); ;
        localelem++) {
     Split3(localelem, melem, true);
     if (Max3(melem) / Min3(melem) <= 2) break;
   }
+  // Each thread needs at least one slab of elements
+  nthreads = PetscMax(1, PetscMin(nthreads, melem[0]));
 
   // Find my location in the process grid
   ierr = MPI_Comm_rank(comm, &rank); CHKERRQ(ierr);
@@ -244,32 +1493,77 @@ int main(int argc, char **argv) {
   }
 
   GlobalDof(p, irank, degree, melem, mdof);
+  nowned = mdof[0]*mdof[1]*mdof[2];
+  for (int d=0; d<3; d++) ghostdir[d] = (irank[d] != p[d]-1);
 
+  ierr = PetscLogStagePush(stage_setup); CHKERRQ(ierr);
   ierr = VecCreate(comm, &X); CHKERRQ(ierr);
-  ierr = VecSetSizes(X, mdof[0] * mdof[1] * mdof[2], PETSC_DECIDE); CHKERRQ(ierr);
+  ierr = VecSetSizes(X, ncomp*nowned, PETSC_DECIDE); CHKERRQ(ierr);
   ierr = VecSetUp(X); CHKERRQ(ierr);
 
   if (!test_mode) {
     CeedInt gsize;
     ierr = VecGetSize(X, &gsize); CHKERRQ(ierr);
+    ierr = PetscPrintf(comm, "Problem: BP%D\n", problem); CHKERRQ(ierr);
     ierr = PetscPrintf(comm, "Global dofs: %D\n", gsize); CHKERRQ(ierr);
     ierr = PetscPrintf(comm, "Process decomposition: %D %D %D\n",
                        p[0], p[1], p[2]); CHKERRQ(ierr);
     ierr = PetscPrintf(comm, "Local elements: %D = %D %D %D\n", localelem,
                        melem[0], melem[1], melem[2]); CHKERRQ(ierr);
-    ierr = PetscPrintf(comm, "Owned dofs: %D = %D %D %D\n",
-                       mdof[0]*mdof[1]*mdof[2], mdof[0], mdof[1], mdof[2]); CHKERRQ(ierr);
+    ierr = PetscPrintf(comm, "Owned dofs: %D = %D %D %D x %D\n", ncomp*nowned,
+                       mdof[0], mdof[1], mdof[2], ncomp); CHKERRQ(ierr);
+    if (nthreads > 1) {
+      ierr = PetscPrintf(comm, "Threads: %D\n", nthreads); CHKERRQ(ierr);
+    }
+    if (structured) {
+      // The PetscInt index array of the solution space restriction is not
+      // stored, nor read by the restriction and its transpose in each apply.
+      // In exchange, the operator acts on the element vectors of one batch
+      // of elements at a time (xceed and yceed), which stay in cache.
+      const PetscInt P3 = (degree+1)*(degree+1)*(degree+1),
+                     nb = StructuredBatchSize(melem, degree+1, ncomp);
+      const double idxmem = localelem*P3*sizeof(PetscInt)/1048576.,
+                   batchmem = 2*ncomp*nb*P3*sizeof(CeedScalar)/1048576.;
+      ierr = PetscPrintf(comm, "Structured restriction, %D elements per "
+                         "batch, memory per process: %g MiB net saved (%g "
+                         "MiB of indices saved, %g MiB of batch element "
+                         "vectors added)\n", nb, idxmem - batchmem, idxmem,
+                         batchmem); CHKERRQ(ierr);
+      ierr = PetscPrintf(comm, "Structured restriction, bytes moved per "
+                         "apply per process: %g MiB of index reads saved\n",
+                         2*idxmem); CHKERRQ(ierr);
+    }
+    if (onthefly) {
+      // The stored quadrature data is replaced by the vertex coordinates
+      const PetscInt Q = degree + 1 + qextra;
+      const double qdatamem = localelem*Q*Q*Q*sizeof(CeedScalar)/1048576.,
+                   xmem = 3*(melem[0]+1)*(melem[1]+1)*(melem[2]+1)*
+                          sizeof(CeedScalar)/1048576.;
+      ierr = PetscPrintf(comm, "On-the-fly geometry, quadrature data memory "
+                         "saved: %g MiB per process (%g MiB instead of %g "
+                         "MiB)\n", qdatamem - xmem, xmem, qdatamem);
+      CHKERRQ(ierr);
+    }
   }
 
+  ierr = PetscLogStagePush(stage_restriction); CHKERRQ(ierr);
+  my_rt_start = MPI_Wtime();
   {
     lsize = 1;
     for (int d=0; d<3; d++) {
       ldof[d] = melem[d]*degree + 1;
       lsize *= ldof[d];
     }
-    ierr = VecCreate(PETSC_COMM_SELF, &Xloc); CHKERRQ(ierr);
-    ierr = VecSetSizes(Xloc, lsize, PETSC_DECIDE); CHKERRQ(ierr);
-    ierr = VecSetUp(Xloc); CHKERRQ(ierr);
+    if (bind) {
+      // The arrays of the local vectors are shared with the CeedVectors
+      ierr = PetscMalloc1(ncomp*lsize, &xlocarray); CHKERRQ(ierr);
+      ierr = VecCreateSeqWithArray(PETSC_COMM_SELF, 1, ncomp*lsize, xlocarray,
+                                   &Xloc); CHKERRQ(ierr);
+    } else {
+      ierr = VecCreate(PETSC_COMM_SELF, &Xloc); CHKERRQ(ierr);
+      ierr = VecSetSizes(Xloc, ncomp*lsize, PETSC_DECIDE); CHKERRQ(ierr);
+      ierr = VecSetUp(Xloc); CHKERRQ(ierr);
+    }
 
     // Create local-to-global scatter
     PetscInt *ltogind;
@@ -286,230 +1580,462 @@ int main(int argc, char **argv) {
       }
     }
 
-    ierr = PetscMalloc1(lsize, &ltogind); CHKERRQ(ierr);
+    {
+      // The closed form must agree with the ownership range of X
+      PetscInt rstart;
+      ierr = VecGetOwnershipRange(X, &rstart, NULL); CHKERRQ(ierr);
+      if (ncomp*gstart[0][0][0] != rstart)
+        SETERRQ2(PETSC_COMM_SELF, PETSC_ERR_PLIB,
+                 "Global start %D does not match ownership range start %D",
+                 ncomp*gstart[0][0][0], rstart);
+    }
+
+    // The global dofs interleave the components of each node
+    ierr = PetscMalloc1(ncomp*lsize, &ltogind); CHKERRQ(ierr);
     for (PetscInt i=0,ir,ii; ir=i>=mdof[0], ii=i-ir*mdof[0], i<ldof[0]; i++) {
       for (PetscInt j=0,jr,jj; jr=j>=mdof[1], jj=j-jr*mdof[1], j<ldof[1]; j++) {
         for (PetscInt k=0,kr,kk; kr=k>=mdof[2], kk=k-kr*mdof[2], k<ldof[2]; k++) {
-          ltogind[(i*ldof[1]+j)*ldof[2]+k] =
+          const PetscInt l = (i*ldof[1]+j)*ldof[2]+k, g =
             gstart[ir][jr][kr] + (ii*gmdof[ir][jr][kr][1]+jj)*gmdof[ir][jr][kr][2]+kk;
+          for (CeedInt c=0; c<ncomp; c++)
+            ltogind[l + c*lsize] = ncomp*g + c;
         }
       }
     }
-    ierr = ISCreateGeneral(comm, lsize, ltogind, PETSC_OWN_POINTER, &ltogis);
-    CHKERRQ(ierr);
+    if (overlap || bind) {
+      // Split the local dofs into the owned dofs, copied locally, and the
+      // ghost dofs, exchanged by the 'ghost' scatter
+      PetscInt nghost = 0, *ghostloc, *ghostind;
+      IS ghostlocis, ghostis;
+      ierr = PetscMalloc1(nowned, &ownedloc); CHKERRQ(ierr);
+      ierr = PetscMalloc1(ncomp*(lsize - nowned), &ghostloc); CHKERRQ(ierr);
+      ierr = PetscMalloc1(ncomp*(lsize - nowned), &ghostind); CHKERRQ(ierr);
+      for (PetscInt i=0; i<ldof[0]; i++) {
+        for (PetscInt j=0; j<ldof[1]; j++) {
+          for (PetscInt k=0; k<ldof[2]; k++) {
+            const PetscInt l = (i*ldof[1]+j)*ldof[2]+k;
+            if (i < mdof[0] && j < mdof[1] && k < mdof[2]) {
+              ownedloc[(i*mdof[1]+j)*mdof[2]+k] = l;
+            } else {
+              for (CeedInt c=0; c<ncomp; c++) {
+                ghostloc[nghost] = l + c*lsize;
+                ghostind[nghost++] = ltogind[l + c*lsize];
+              }
+            }
+          }
+        }
+      }
+      ierr = ISCreateGeneral(PETSC_COMM_SELF, nghost, ghostloc,
+                             PETSC_OWN_POINTER, &ghostlocis); CHKERRQ(ierr);
+      ierr = ISCreateGeneral(comm, nghost, ghostind, PETSC_OWN_POINTER,
+                             &ghostis); CHKERRQ(ierr);
+      ierr = VecScatterCreateWithData(Xloc, ghostlocis, X, ghostis, &ghost);
+      CHKERRQ(ierr);
+      ierr = ISDestroy(&ghostlocis); CHKERRQ(ierr);
+      ierr = ISDestroy(&ghostis); CHKERRQ(ierr);
+    }
+    if (overlap) {
+      // The nodes of the process-boundary elements, the last element layer
+      // in each direction with ghost dofs, numbered in local order; the
+      // output of these elements only stores these nodes, and its ghost dofs
+      // are exchanged by the 'bghost' scatter
+      PetscInt nbghost = 0, *bghostloc, *bghostind;
+      IS bghostlocis, bghostis;
+      for (PetscInt pass=0; pass<2; pass++) {
+        if (pass) {
+          ierr = PetscMalloc1(nbnode, &bnodeloc); CHKERRQ(ierr);
+          ierr = PetscMalloc1(nbnode, &bnodeown); CHKERRQ(ierr);
+          nbnode = 0;
+        }
+        for (PetscInt i=0; i<ldof[0]; i++) {
+          for (PetscInt j=0; j<ldof[1]; j++) {
+            for (PetscInt k=0; k<ldof[2]; k++) {
+              if (!((ghostdir[0] && i >= (melem[0]-1)*degree) ||
+                    (ghostdir[1] && j >= (melem[1]-1)*degree) ||
+                    (ghostdir[2] && k >= (melem[2]-1)*degree))) continue;
+              if (pass) {
+                bnodeloc[nbnode] = (i*ldof[1]+j)*ldof[2]+k;
+                bnodeown[nbnode] = (i < mdof[0] && j < mdof[1] &&
+                                    k < mdof[2]) ?
+                                   (i*mdof[1]+j)*mdof[2]+k : -1;
+              }
+              nbnode++;
+            }
+          }
+        }
+      }
+      ierr = PetscMalloc1(ncomp*nbnode, &bghostloc); CHKERRQ(ierr);
+      ierr = PetscMalloc1(ncomp*nbnode, &bghostind); CHKERRQ(ierr);
+      for (PetscInt b=0; b<nbnode; b++) {
+        if (bnodeown[b] >= 0) continue;
+        for (CeedInt c=0; c<ncomp; c++) {
+          bghostloc[nbghost] = b + c*nbnode;
+          bghostind[nbghost++] = ltogind[bnodeloc[b] + c*lsize];
+        }
+      }
+      if (bind) {
+        ierr = PetscMalloc1(ncomp*nbnode, &yblocarray); CHKERRQ(ierr);
+        ierr = VecCreateSeqWithArray(PETSC_COMM_SELF, 1, ncomp*nbnode,
+                                     yblocarray, &Ybloc); CHKERRQ(ierr);
+      } else {
+        ierr = VecCreate(PETSC_COMM_SELF, &Ybloc); CHKERRQ(ierr);
+        ierr = VecSetSizes(Ybloc, ncomp*nbnode, PETSC_DECIDE); CHKERRQ(ierr);
+        ierr = VecSetUp(Ybloc); CHKERRQ(ierr);
+      }
+      ierr = ISCreateGeneral(PETSC_COMM_SELF, nbghost, bghostloc,
+                             PETSC_OWN_POINTER, &bghostlocis); CHKERRQ(ierr);
+      ierr = ISCreateGeneral(comm, nbghost, bghostind, PETSC_OWN_POINTER,
+                             &bghostis); CHKERRQ(ierr);
+      ierr = VecScatterCreateWithData(Ybloc, bghostlocis, X, bghostis,
+                                      &bghost); CHKERRQ(ierr);
+      ierr = ISDestroy(&bghostlocis); CHKERRQ(ierr);
+      ierr = ISDestroy(&bghostis); CHKERRQ(ierr);
+    }
+    ierr = ISCreateGeneral(comm, ncomp*lsize, ltogind, PETSC_OWN_POINTER,
+                           &ltogis); CHKERRQ(ierr);
     ierr = VecScatterCreateWithData(Xloc, NULL, X, ltogis, &ltog); CHKERRQ(ierr);
     CHKERRQ(ierr);
     ierr = ISDestroy(&ltogis); CHKERRQ(ierr);
   }
-
-  CeedInit(ceedresource, &ceed);
-  P = degree + 1;
-  Q = P + qextra;
-  CeedBasisCreateTensorH1Lagrange(ceed, 3, 1, P, Q, CEED_GAUSS, &basisu);
-  CeedBasisCreateTensorH1Lagrange(ceed, 3, 3, 2, Q, CEED_GAUSS, &basisx);
-
-  CreateRestriction(ceed, melem, P, 1, &Erestrictu);
-  CreateRestriction(ceed, melem, 2, 3, &Erestrictx);
-  CeedInt nelem = melem[0]*melem[1]*melem[2];
-  CeedElemRestrictionCreateIdentity(ceed, nelem, Q*Q*Q, nelem*Q*Q*Q, 1,
-                                    &Erestrictui);
-  CeedElemRestrictionCreateIdentity(ceed, nelem, Q*Q*Q, nelem*Q*Q*Q, 1,
-                                    &Erestrictxi);
-  {
-    CeedScalar *xloc;
-    CeedInt shape[3] = {melem[0]+1, melem[1]+1, melem[2]+1}, len =
-                         shape[0]*shape[1]*shape[2];
-    xloc = malloc(len*3*sizeof xloc[0]);
-    for (CeedInt i=0; i<shape[0]; i++) {
-      for (CeedInt j=0; j<shape[1]; j++) {
-        for (CeedInt k=0; k<shape[2]; k++) {
-          xloc[((i*shape[1]+j)*shape[2]+k) + 0*len] = 1.*(irank[0]*melem[0]+i) /
-              (p[0]*melem[0]);
-          xloc[((i*shape[1]+j)*shape[2]+k) + 1*len] = 1.*(irank[1]*melem[1]+j) /
-              (p[1]*melem[1]);
-          xloc[((i*shape[1]+j)*shape[2]+k) + 2*len] = 1.*(irank[2]*melem[2]+k) /
-              (p[2]*melem[2]);
-        }
-      }
-    }
-    CeedVectorCreate(ceed, len*3, &xcoord);
-    CeedVectorSetArray(xcoord, CEED_MEM_HOST, CEED_OWN_POINTER, xloc);
+  my_rt = MPI_Wtime() - my_rt_start;
+  ierr = PetscLogStagePop(); CHKERRQ(ierr);
+  if (!test_mode) {
+    MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    ierr = PetscPrintf(comm, "Scatter setup time: %g (%g) sec.\n",
+                       rt_max, rt_min); CHKERRQ(ierr);
   }
 
-  // Create the Q-function that builds the mass operator (i.e. computes its
-  // quadrature data) and set its context data.
-  CeedQFunctionCreateInterior(ceed, 1,
-                              Setup, __FILE__ ":Setup", &qf_setup);
-  CeedQFunctionAddInput(qf_setup, "x", 3, CEED_EVAL_INTERP);
-  CeedQFunctionAddInput(qf_setup, "dx", 3, CEED_EVAL_GRAD);
-  CeedQFunctionAddInput(qf_setup, "weight", 1, CEED_EVAL_WEIGHT);
-  CeedQFunctionAddOutput(qf_setup, "rho", 1, CEED_EVAL_NONE);
-  CeedQFunctionAddOutput(qf_setup, "true_soln", 1, CEED_EVAL_NONE);
-  CeedQFunctionAddOutput(qf_setup, "rhs", 1, CEED_EVAL_INTERP);
-
-  // Create the Q-function that defines the action of the mass operator.
-  CeedQFunctionCreateInterior(ceed, 1,
-                              Mass, __FILE__ ":Mass", &qf_mass);
-  CeedQFunctionAddInput(qf_mass, "u", 1, CEED_EVAL_INTERP);
-  CeedQFunctionAddInput(qf_mass, "rho", 1, CEED_EVAL_NONE);
-  CeedQFunctionAddOutput(qf_mass, "v", 1, CEED_EVAL_INTERP);
-
-  // Create the error qfunction
-  CeedQFunctionCreateInterior(ceed, 1,
-                              Error, __FILE__ ":Error", &qf_error);
-  CeedQFunctionAddInput(qf_error, "u", 1, CEED_EVAL_INTERP);
-  CeedQFunctionAddInput(qf_error, "true_soln", 1, CEED_EVAL_NONE);
-  CeedQFunctionAddOutput(qf_error, "error", 1, CEED_EVAL_NONE);
-
-  // Create the persistent vectors that will be needed in setup
-  CeedInt Nqpts, Nelem = melem[0]*melem[1]*melem[2];
-  CeedBasisGetNumQuadraturePoints(basisu, &Nqpts);
-  CeedVectorCreate(ceed, Nelem*Nqpts, &rho);
-  CeedVectorCreate(ceed, Nelem*Nqpts, &target);
-  CeedVectorCreate(ceed, lsize, &rhsceed);
-
-  // Create the operator that builds the quadrature data for the mass operator.
-  CeedOperatorCreate(ceed, qf_setup, NULL, NULL, &op_setup);
-  CeedOperatorSetField(op_setup, "x", Erestrictx, basisx, CEED_VECTOR_ACTIVE);
-  CeedOperatorSetField(op_setup, "dx", Erestrictx, basisx, CEED_VECTOR_ACTIVE);
-  CeedOperatorSetField(op_setup, "weight", Erestrictxi, basisx,
-                       CEED_VECTOR_NONE);
-  CeedOperatorSetField(op_setup, "rho", Erestrictui,
-                       CEED_BASIS_COLLOCATED, CEED_VECTOR_ACTIVE);
-  CeedOperatorSetField(op_setup, "true_soln", Erestrictui,
-                       CEED_BASIS_COLLOCATED, target);
-  CeedOperatorSetField(op_setup, "rhs", Erestrictu, basisu, rhsceed);
-
-  // Create the mass operator.
-  CeedOperatorCreate(ceed, qf_mass, NULL, NULL, &op_mass);
-  CeedOperatorSetField(op_mass, "u", Erestrictu, basisu, CEED_VECTOR_ACTIVE);
-  CeedOperatorSetField(op_mass, "rho", Erestrictui,
-                       CEED_BASIS_COLLOCATED, rho);
-  CeedOperatorSetField(op_mass, "v", Erestrictu, basisu, CEED_VECTOR_ACTIVE);
-
-  // Create the error operator
-  CeedOperatorCreate(ceed, qf_error, NULL, NULL, &op_error);
-  CeedOperatorSetField(op_error, "u", Erestrictu, basisu, CEED_VECTOR_ACTIVE);
-  CeedOperatorSetField(op_error, "true_soln", Erestrictui,
-                       CEED_BASIS_COLLOCATED, target);
-  CeedOperatorSetField(op_error, "error", Erestrictui,
-                       CEED_BASIS_COLLOCATED, CEED_VECTOR_ACTIVE);
-
+  if (bp->diffusion) {
+    // Local and owned nodes for the homogeneous Dirichlet conditions
+    for (PetscInt i=0; i<ldof[0]; i++)
+      for (PetscInt j=0; j<ldof[1]; j++)
+        for (PetscInt k=0; k<ldof[2]; k++)
+          if (GlobalBoundaryNode(p, irank, degree, melem, i, j, k)) {
+            nbcloc++;
+            nbcown += (i < mdof[0] && j < mdof[1] && k < mdof[2]);
+          }
+    ierr = PetscMalloc1(nbcloc, &bcloc); CHKERRQ(ierr);
+    ierr = PetscMalloc1(nbcown, &bcown); CHKERRQ(ierr);
+    nbcloc = nbcown = 0;
+    for (PetscInt i=0; i<ldof[0]; i++)
+      for (PetscInt j=0; j<ldof[1]; j++)
+        for (PetscInt k=0; k<ldof[2]; k++)
+          if (GlobalBoundaryNode(p, irank, degree, melem, i, j, k)) {
+            bcloc[nbcloc++] = (i*ldof[1]+j)*ldof[2]+k;
+            if (i < mdof[0] && j < mdof[1] && k < mdof[2])
+              bcown[nbcown++] = (i*mdof[1]+j)*mdof[2]+k;
+          }
+  }
 
   // Set up Mat
   ierr = PetscMalloc1(1, &user); CHKERRQ(ierr);
   user->comm = comm;
   user->ltog = ltog;
   user->Xloc = Xloc;
-  ierr = VecDuplicate(Xloc, &user->Yloc); CHKERRQ(ierr);
-  CeedVectorCreate(ceed, lsize, &user->xceed);
-  CeedVectorCreate(ceed, lsize, &user->yceed);
-  user->op = op_mass;
-  user->rho = rho;
-  user->ceed = ceed;
-
-  ierr = MatCreateShell(comm, mdof[0]*mdof[1]*mdof[2], mdof[0]*mdof[1]*mdof[2],
+  user->bound = bind;
+  user->xloc = xlocarray;
+  if (bind) {
+    ierr = PetscMalloc1(ncomp*lsize, &ylocarray); CHKERRQ(ierr);
+    ierr = VecCreateSeqWithArray(PETSC_COMM_SELF, 1, ncomp*lsize, ylocarray,
+                                 &user->Yloc); CHKERRQ(ierr);
+  } else {
+    ierr = VecDuplicate(Xloc, &user->Yloc); CHKERRQ(ierr);
+  }
+  user->yloc = ylocarray;
+  user->structured = structured;
+  for (int d=0; d<3; d++) user->melem[d] = melem[d];
+  user->P = degree + 1;
+  user->nbatch = structured ? StructuredBatchSize(user->melem, user->P, ncomp)
+                 : 0;
+  user->nthreads = nthreads;
+  ierr = PetscMalloc1(nthreads, &user->tops); CHKERRQ(ierr);
+  user->ncomp = ncomp;
+  user->lsize = lsize;
+  user->nbcloc = nbcloc;
+  user->bcloc = bcloc;
+  user->nbcown = nbcown;
+  user->bcown = bcown;
+  user->ghost = ghost;
+  user->nowned = nowned;
+  user->ownedloc = ownedloc;
+  user->bghost = bghost;
+  user->nbnode = nbnode;
+  user->bnodeown = bnodeown;
+  user->Ybloc = Ybloc;
+  user->ybloc = yblocarray;
+
+  ierr = MatCreateShell(comm, ncomp*nowned, ncomp*nowned,
                         PETSC_DECIDE, PETSC_DECIDE, user, &mat); CHKERRQ(ierr);
-  ierr = MatShellSetOperation(mat, MATOP_MULT, (void(*)(void))MatMult_Mass);
+  ierr = MatShellSetOperation(mat, MATOP_MULT, overlap ?
+                              (void(*)(void))MatMult_CeedOverlap : bind ?
+                              (void(*)(void))MatMult_CeedBound :
+                              (void(*)(void))MatMult_Ceed);
+  CHKERRQ(ierr);
+  ierr = MatShellSetOperation(mat, MATOP_GET_DIAGONAL,
+                              (void(*)(void))MatGetDiagonal_Ceed);
   CHKERRQ(ierr);
   ierr = MatCreateVecs(mat, &rhs, NULL); CHKERRQ(ierr);
-
-  // Get RHS vector
   ierr = VecDuplicate(Xloc, &rhsloc); CHKERRQ(ierr);
-  ierr = VecZeroEntries(rhsloc); CHKERRQ(ierr);
-  ierr = VecGetArray(rhsloc, &r); CHKERRQ(ierr);
-  CeedVectorSetArray(rhsceed, CEED_MEM_HOST, CEED_USE_POINTER, r);
+  ierr = VecDuplicate(X, &X0); CHKERRQ(ierr);
+  ierr = VecDuplicate(X, &Y0); CHKERRQ(ierr);
+  ierr = VecDuplicate(X, &Y); CHKERRQ(ierr);
+  ierr = VecDuplicate(X, &user->diag); CHKERRQ(ierr);
+  ierr = PetscLogStagePop(); CHKERRQ(ierr);
 
-  // Setup rho, rhs, and target
-  CeedOperatorApply(op_setup, xcoord, rho, CEED_REQUEST_IMMEDIATE);
-  CeedVectorDestroy(&xcoord);
+  // Build, time, and solve with each backend on the same mesh and element
+  // restriction, and compare with the first backend
+  for (PetscInt b=0; b<nbackends; b++) {
+    struct CeedData_ ceeddata;
+    PetscInt its;
+    double apply_time = 0., solve_time, diag_time = 0.;
 
-  // Gather RHS
-  ierr = VecRestoreArray(rhsloc, &r); CHKERRQ(ierr);
-  ierr = VecZeroEntries(rhs); CHKERRQ(ierr);
-  ierr = VecScatterBegin(ltog, rhsloc, rhs, ADD_VALUES, SCATTER_FORWARD);
-  CHKERRQ(ierr);
-  ierr = VecScatterEnd(ltog, rhsloc, rhs, ADD_VALUES, SCATTER_FORWARD);
-  CHKERRQ(ierr);
-  CeedVectorDestroy(&rhsceed);
+    ierr = PetscLogStagePush(stage_setup); CHKERRQ(ierr);
+    if (!test_mode && nbackends > 1) {
+      ierr = PetscPrintf(comm, "Backend: %s\n", backends[b]); CHKERRQ(ierr);
+    }
+    ierr = SetupCeedData(backends[b], bp, degree, qextra, melem, p, irank,
+                         ghostdir, overlap, structured, onthefly, lsize,
+                         nbnode, bnodeloc, rhsloc, &ceeddata);
+    CHKERRQ(ierr);
+    UserSetCeedData(user, &ceeddata);
+    if (nthreads > 1) {
+      ierr = SetupThreadOps(backends[b], bp, degree, qextra, melem, nthreads,
+                            ceeddata.qdata, user->tops); CHKERRQ(ierr);
+    }
+    if (precond != PRECOND_NONE) {
+      my_rt_start = MPI_Wtime();
+      ierr = ComputeDiagonal(user, user->diag); CHKERRQ(ierr);
+      user->diag_valid = PETSC_TRUE;
+      my_rt = MPI_Wtime() - my_rt_start;
+      ierr = MPI_Allreduce(&my_rt, &diag_time, 1, MPI_DOUBLE, MPI_MAX, comm);
+      CHKERRQ(ierr);
+      if (!test_mode) {
+        ierr = PetscPrintf(comm, "Diagonal setup time: %g sec.\n", diag_time);
+        CHKERRQ(ierr);
+      }
+    }
 
-  ierr = KSPCreate(comm, &ksp); CHKERRQ(ierr);
-  {
-    PC pc;
-    ierr = KSPGetPC(ksp, &pc); CHKERRQ(ierr);
-    ierr = PCSetType(pc, PCJACOBI); CHKERRQ(ierr);
-    ierr = PCJacobiSetType(pc, PC_JACOBI_ROWSUM); CHKERRQ(ierr);
-    ierr = KSPSetType(ksp, KSPCG); CHKERRQ(ierr);
-    ierr = KSPSetTolerances(ksp, 1e-10, PETSC_DEFAULT, PETSC_DEFAULT,
-                            PETSC_DEFAULT); CHKERRQ(ierr);
-  }
-  ierr = KSPSetFromOptions(ksp); CHKERRQ(ierr);
-  ierr = KSPSetOperators(ksp, mat, mat); CHKERRQ(ierr);
-  my_rt_start = MPI_Wtime();
-  ierr = KSPSolve(ksp, rhs, X); CHKERRQ(ierr);
-  my_rt = MPI_Wtime() - my_rt_start;
-  {
-    KSPType ksptype;
-    KSPConvergedReason reason;
-    PetscReal rnorm;
-    PetscInt its;
-    ierr = KSPGetType(ksp, &ksptype); CHKERRQ(ierr);
-    ierr = KSPGetConvergedReason(ksp, &reason); CHKERRQ(ierr);
-    ierr = KSPGetIterationNumber(ksp, &its); CHKERRQ(ierr);
-    ierr = KSPGetResidualNorm(ksp, &rnorm); CHKERRQ(ierr);
-    if (!test_mode || reason < 0 || rnorm > 1e-8) {
-      ierr = PetscPrintf(comm, "KSP %s %s iterations %D rnorm %e\n", ksptype,
-                         KSPConvergedReasons[reason], its, (double)rnorm); CHKERRQ(ierr);
+    // Gather RHS
+    ierr = VecZeroEntries(rhs); CHKERRQ(ierr);
+    ierr = VecScatterBegin(ltog, rhsloc, rhs, ADD_VALUES, SCATTER_FORWARD);
+    CHKERRQ(ierr);
+    ierr = VecScatterEnd(ltog, rhsloc, rhs, ADD_VALUES, SCATTER_FORWARD);
+    CHKERRQ(ierr);
+    if (nbcown) {
+      // Homogeneous Dirichlet conditions
+      ierr = VecGetArray(rhs, &r); CHKERRQ(ierr);
+      for (PetscInt i=0; i<nbcown; i++)
+        for (CeedInt c=0; c<ncomp; c++)
+          r[ncomp*bcown[i]+c] = 0.;
+      ierr = VecRestoreArray(rhs, &r); CHKERRQ(ierr);
     }
-    if (!test_mode) {
-      CeedInt gsize;
-      ierr = VecGetSize(X, &gsize); CHKERRQ(ierr);
-      MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
-      MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
-      ierr = PetscPrintf(comm,
-                         "CG solve time  : %g (%g) sec.\n"
-                         "DOFs/sec in CG : %g (%g) million.\n",
-                         rt_max, rt_min,
-                         1e-6*gsize*its/rt_max, 1e-6*gsize*its/rt_min);
+    ierr = PetscLogStagePop(); CHKERRQ(ierr);
+
+    if (nmult > 0) {
+      // Time the operator apply alone, after one warm-up apply
+      ierr = MatMult(mat, rhs, Y); CHKERRQ(ierr);
+      ierr = MPI_Barrier(comm); CHKERRQ(ierr);
+      my_rt_start = MPI_Wtime();
+      for (PetscInt i=0; i<nmult; i++) {
+        ierr = MatMult(mat, rhs, Y); CHKERRQ(ierr);
+      }
+      my_rt = (MPI_Wtime() - my_rt_start)/nmult;
+      ierr = MPI_Allreduce(&my_rt, &apply_time, 1, MPI_DOUBLE, MPI_MAX, comm);
       CHKERRQ(ierr);
+      user->num_mult = 0;
+      user->wait_time = 0.;
+      if (!test_mode) {
+        CeedInt gsize;
+        ierr = VecGetSize(X, &gsize); CHKERRQ(ierr);
+        ierr = PetscPrintf(comm,
+                           "Operator apply time  : %g sec.\n"
+                           "DOFs/sec in apply    : %g million.\n",
+                           apply_time, 1e-6*gsize/apply_time); CHKERRQ(ierr);
+      }
     }
+
+    ierr = CreateSolver(comm, mat, precond, chebyshev_its, &ksp);
+    CHKERRQ(ierr);
+    ierr = KSPSetFromOptions(ksp); CHKERRQ(ierr);
+    ierr = VecZeroEntries(X); CHKERRQ(ierr);
+    ierr = PetscLogStagePush(stage_solve); CHKERRQ(ierr);
+    my_rt_start = MPI_Wtime();
+    ierr = KSPSolve(ksp, rhs, X); CHKERRQ(ierr);
+    my_rt = MPI_Wtime() - my_rt_start;
+    ierr = PetscLogStagePop(); CHKERRQ(ierr);
+    ierr = MPI_Allreduce(&my_rt, &solve_time, 1, MPI_DOUBLE, MPI_MAX, comm);
+    CHKERRQ(ierr);
+    {
+      KSPType ksptype;
+      KSPConvergedReason reason;
+      PetscReal rnorm;
+      ierr = KSPGetType(ksp, &ksptype); CHKERRQ(ierr);
+      ierr = KSPGetConvergedReason(ksp, &reason); CHKERRQ(ierr);
+      ierr = KSPGetIterationNumber(ksp, &its); CHKERRQ(ierr);
+      ierr = KSPGetResidualNorm(ksp, &rnorm); CHKERRQ(ierr);
+      if (!test_mode || reason < 0 || rnorm > 1e-8) {
+        ierr = PetscPrintf(comm, "KSP %s %s iterations %D rnorm %e\n", ksptype,
+                           KSPConvergedReasons[reason], its, (double)rnorm);
+        CHKERRQ(ierr);
+      }
+      if (!test_mode) {
+        CeedInt gsize;
+        ierr = VecGetSize(X, &gsize); CHKERRQ(ierr);
+        MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+        MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+        ierr = PetscPrintf(comm,
+                           "CG solve time  : %g (%g) sec.\n"
+                           "DOFs/sec in CG : %g (%g) million.\n",
+                           rt_max, rt_min,
+                           1e-6*gsize*its/rt_max, 1e-6*gsize*its/rt_min);
+        CHKERRQ(ierr);
+      }
+      if (!test_mode && precond != PRECOND_NONE) {
+        // Reference solve without preconditioner; the MatMult counters of the
+        // preconditioned solve are kept for the -overlap report below
+        KSP ksp0;
+        PetscInt its0, num_mult = user->num_mult;
+        double solve_time0, wait_time = user->wait_time;
+        ierr = CreateSolver(comm, mat, PRECOND_NONE, 0, &ksp0); CHKERRQ(ierr);
+        ierr = VecZeroEntries(Y); CHKERRQ(ierr);
+        my_rt_start = MPI_Wtime();
+        ierr = KSPSolve(ksp0, rhs, Y); CHKERRQ(ierr);
+        my_rt = MPI_Wtime() - my_rt_start;
+        ierr = MPI_Allreduce(&my_rt, &solve_time0, 1, MPI_DOUBLE, MPI_MAX,
+                             comm); CHKERRQ(ierr);
+        ierr = KSPGetIterationNumber(ksp0, &its0); CHKERRQ(ierr);
+        ierr = KSPDestroy(&ksp0); CHKERRQ(ierr);
+        // The time to solution includes the setup of the diagonal, which is
+        // not needed without the preconditioner
+        ierr = PetscPrintf(comm,
+                           "Preconditioner %s: iterations %D vs. %D, solve "
+                           "time %g vs. %g sec. (speedup %g) without "
+                           "preconditioner\n", precondtypes[precond], its,
+                           its0, solve_time, solve_time0,
+                           solve_time0/solve_time); CHKERRQ(ierr);
+        ierr = PetscPrintf(comm,
+                           "Preconditioner %s: time to solution, with the "
+                           "diagonal setup, %g vs. %g sec. (speedup %g) "
+                           "without preconditioner\n", precondtypes[precond],
+                           diag_time + solve_time, solve_time0,
+                           solve_time0/(diag_time + solve_time));
+        CHKERRQ(ierr);
+        user->num_mult = num_mult;
+        user->wait_time = wait_time;
+      }
+      if (!test_mode && overlap) {
+        // The communication not exposed as waiting time in MatMult is hidden
+        // behind the interior elements and the local copies
+        double comm_time, wait_time;
+        ierr = TimeGhostExchange(user, X, 10, &comm_time); CHKERRQ(ierr);
+        my_rt = user->wait_time/user->num_mult;
+        ierr = MPI_Allreduce(&my_rt, &wait_time, 1, MPI_DOUBLE, MPI_MAX, comm);
+        CHKERRQ(ierr);
+        ierr = PetscPrintf(comm,
+                           "MatMult communication time : %g sec.\n"
+                           "MatMult exposed comm. time : %g sec.\n"
+                           "MatMult hidden comm. time  : %g sec.\n",
+                           comm_time, wait_time,
+                           PetscMax(comm_time - wait_time, 0.)); CHKERRQ(ierr);
+      }
+    }
+    ierr = KSPDestroy(&ksp); CHKERRQ(ierr);
+
+    {
+      PetscReal maxerror;
+      ierr = ComputeErrorMax(user, ceeddata.op_error, X, ceeddata.target,
+                             &maxerror); CHKERRQ(ierr);
+      if (!test_mode || maxerror > 5e-3) {
+        ierr = PetscPrintf(comm, "Pointwise error (max) %e\n", (double)maxerror);
+        CHKERRQ(ierr);
+      }
+    }
+
+    // Compare the solution and the action of the operator with the first
+    // backend, relative to the max norm of the first backend's results
+    PetscReal diff = 0.;
+    if (b == 0) {
+      ierr = VecCopy(X, X0); CHKERRQ(ierr);
+      ierr = MatMult(mat, X0, Y0); CHKERRQ(ierr);
+    } else {
+      PetscReal nrm0, nrm;
+      ierr = VecNorm(X0, NORM_INFINITY, &nrm0); CHKERRQ(ierr);
+      ierr = VecAXPY(X, -1., X0); CHKERRQ(ierr);
+      ierr = VecNorm(X, NORM_INFINITY, &nrm); CHKERRQ(ierr);
+      diff = nrm/nrm0;
+      ierr = MatMult(mat, X0, Y); CHKERRQ(ierr);
+      ierr = VecNorm(Y0, NORM_INFINITY, &nrm0); CHKERRQ(ierr);
+      ierr = VecAXPY(Y, -1., Y0); CHKERRQ(ierr);
+      ierr = VecNorm(Y, NORM_INFINITY, &nrm); CHKERRQ(ierr);
+      diff = PetscMax(diff, nrm/nrm0);
+      if (diff > backend_tol) nfailed++;
+      if (!test_mode || diff > backend_tol) {
+        ierr = PetscPrintf(comm, "Difference from %s: %e %s\n", backends[0],
+                           (double)diff, diff > backend_tol ? "FAILED" : "PASSED");
+        CHKERRQ(ierr);
+      }
+    }
+    stats[b].apply_time = apply_time;
+    stats[b].solve_time = solve_time;
+    stats[b].its = its;
+    stats[b].diff = diff;
+
+    if (nthreads > 1) {
+      ierr = DestroyThreadOps(nthreads, user->tops); CHKERRQ(ierr);
+    }
+    ierr = DestroyCeedData(&ceeddata, overlap); CHKERRQ(ierr);
   }
 
-  {
-    PetscReal maxerror;
-    ierr = ComputeErrorMax(user, op_error, X, target, &maxerror); CHKERRQ(ierr);
-    if (!test_mode || maxerror > 5e-3) {
-      ierr = PetscPrintf(comm, "Pointwise error (max) %e\n", (double)maxerror);
-      CHKERRQ(ierr);
+  if (!test_mode && nbackends > 1) {
+    CeedInt gsize;
+    ierr = VecGetSize(X, &gsize); CHKERRQ(ierr);
+    ierr = PetscPrintf(comm, "\n%-24s %12s %12s %6s %12s %12s %12s\n",
+                       "Backend", "Apply (s)", "MDOFs/s", "Its", "Solve (s)",
+                       "MDOFs/s CG", "Difference"); CHKERRQ(ierr);
+    for (PetscInt b=0; b<nbackends; b++) {
+      ierr = PetscPrintf(comm, "%-24s %12.4e %12.4g %6D %12.4e %12.4g %12.4e\n",
+                         backends[b], stats[b].apply_time,
+                         stats[b].apply_time > 0. ?
+                         1e-6*gsize/stats[b].apply_time : 0.,
+                         stats[b].its, stats[b].solve_time,
+                         1e-6*gsize*stats[b].its/stats[b].solve_time,
+                         (double)stats[b].diff); CHKERRQ(ierr);
     }
   }
 
   ierr = VecDestroy(&rhs); CHKERRQ(ierr);
   ierr = VecDestroy(&rhsloc); CHKERRQ(ierr);
   ierr = VecDestroy(&X); CHKERRQ(ierr);
+  ierr = VecDestroy(&X0); CHKERRQ(ierr);
+  ierr = VecDestroy(&Y0); CHKERRQ(ierr);
+  ierr = VecDestroy(&Y); CHKERRQ(ierr);
+  ierr = VecDestroy(&user->diag); CHKERRQ(ierr);
   ierr = VecDestroy(&user->Xloc); CHKERRQ(ierr);
   ierr = VecDestroy(&user->Yloc); CHKERRQ(ierr);
   ierr = VecScatterDestroy(&ltog); CHKERRQ(ierr);
+  if (overlap) {
+    ierr = VecDestroy(&user->Ybloc); CHKERRQ(ierr);
+    ierr = VecScatterDestroy(&bghost); CHKERRQ(ierr);
+    ierr = PetscFree(bnodeloc); CHKERRQ(ierr);
+    ierr = PetscFree(bnodeown); CHKERRQ(ierr);
+  }
+  if (overlap || bind) {
+    ierr = VecScatterDestroy(&ghost); CHKERRQ(ierr);
+    ierr = PetscFree(ownedloc); CHKERRQ(ierr);
+  }
+  ierr = PetscFree(xlocarray); CHKERRQ(ierr);
+  ierr = PetscFree(ylocarray); CHKERRQ(ierr);
+  ierr = PetscFree(yblocarray); CHKERRQ(ierr);
   ierr = MatDestroy(&mat); CHKERRQ(ierr);
-  ierr = KSPDestroy(&ksp); CHKERRQ(ierr);
-
-  CeedVectorDestroy(&user->xceed);
-  CeedVectorDestroy(&user->yceed);
-  CeedVectorDestroy(&user->rho);
-  CeedVectorDestroy(&target);
-  CeedOperatorDestroy(&op_setup);
-  CeedOperatorDestroy(&op_mass);
-  CeedOperatorDestroy(&op_error);
-  CeedElemRestrictionDestroy(&Erestrictu);
-  CeedElemRestrictionDestroy(&Erestrictx);
-  CeedElemRestrictionDestroy(&Erestrictui);
-  CeedElemRestrictionDestroy(&Erestrictxi);
-  CeedQFunctionDestroy(&qf_setup);
-  CeedQFunctionDestroy(&qf_mass);
-  CeedQFunctionDestroy(&qf_error);
-  CeedBasisDestroy(&basisu);
-  CeedBasisDestroy(&basisx);
-  CeedDestroy(&ceed);
+
+  for (PetscInt b=0; b<nbackends; b++) {
+    ierr = PetscFree(backends[b]); CHKERRQ(ierr);
+  }
+  ierr = PetscFree(bcloc); CHKERRQ(ierr);
+  ierr = PetscFree(bcown); CHKERRQ(ierr);
+  ierr = PetscFree(user->tops); CHKERRQ(ierr);
   ierr = PetscFree(user); CHKERRQ(ierr);
-  return PetscFinalize();
+  ierr = PetscFinalize();
+  return ierr ? ierr : (nfailed > 0);
 }
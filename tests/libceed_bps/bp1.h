@@ -22,9 +22,30 @@
 #include <ceed.h>
 
 // *****************************************************************************
-static int Setup(void *ctx, CeedInt Q,
-                 const CeedScalar *const *in, CeedScalar *const *out) {
-  CeedScalar *rho = out[0], *true_soln = out[1], *rhs = out[2];
+// Q-functions of the CEED benchmark problems. The setup Q-functions take the
+// number of components of the solution as context and store the quadrature
+// data, the true solution and the right-hand side at the quadrature points.
+
+// Component c of the (vector) true solution of the mass problems
+static inline CeedScalar MassSolution(const CeedScalar x[3], CeedInt c) {
+  return (c+1) * PetscSqrtScalar(PetscSqr(x[0]) + PetscSqr(x[1]) +
+                                 PetscSqr(x[2]));
+}
+
+// Component c of the true solution of the diffusion problems; it vanishes on
+// the boundary of the unit cube and -Laplacian(u) = 14*pi^2*u.
+static inline CeedScalar DiffSolution(const CeedScalar x[3], CeedInt c) {
+  return (c+1) * (PetscSinReal(PETSC_PI*x[0]) *
+                  PetscSinReal(PETSC_PI*(1 + 2*x[1])) *
+                  PetscSinReal(PETSC_PI*(2 + 3*x[2])));
+}
+
+static int SetupMass(void *ctx, CeedInt Q,
+                     const CeedScalar *const *in, CeedScalar *const *out) {
+  const CeedInt ncomp = *(const CeedInt *)ctx;
+  CeedScalar *rho = out[0];
+  CeedScalar (*true_soln)[Q] = (CeedScalar (*)[Q])out[1];
+  CeedScalar (*rhs)[Q] = (CeedScalar (*)[Q])out[2];
   const CeedScalar (*x)[Q] = (const CeedScalar (*)[Q])in[0];
   const CeedScalar (*J)[3][Q] = (const CeedScalar (*)[3][Q])in[1];
   const CeedScalar *w = in[2];
@@ -32,10 +53,55 @@ static int Setup(void *ctx, CeedInt Q,
     CeedScalar det = (+ J[0][0][i] * (J[1][1][i]*J[2][2][i] - J[1][2][i]*J[2][1][i])
                       - J[0][1][i] * (J[1][0][i]*J[2][2][i] - J[1][2][i]*J[2][0][i])
                       + J[0][2][i] * (J[1][0][i]*J[2][1][i] - J[1][1][i]*J[2][0][i]));
+    const CeedScalar xi[3] = {x[0][i], x[1][i], x[2][i]};
     rho[i] = det * w[i];
-    true_soln[i] = PetscSqrtScalar(PetscSqr(x[0][i]) + PetscSqr(x[1][i]) + PetscSqr(
-                                  x[2][i]));
-    rhs[i] = rho[i] * true_soln[i];
+    for (CeedInt c=0; c<ncomp; c++) {
+      true_soln[c][i] = MassSolution(xi, c);
+      rhs[c][i] = rho[i] * true_soln[c][i];
+    }
+  }
+  return 0;
+}
+
+// The quadrature data of the diffusion problems is the symmetric matrix
+// w det(M) M^{-1} M^{-T}, M = dx/dxi, stored as (11, 22, 33, 23, 13, 12).
+static int SetupDiff(void *ctx, CeedInt Q,
+                     const CeedScalar *const *in, CeedScalar *const *out) {
+  const CeedInt ncomp = *(const CeedInt *)ctx;
+  CeedScalar (*qd)[Q] = (CeedScalar (*)[Q])out[0];
+  CeedScalar (*true_soln)[Q] = (CeedScalar (*)[Q])out[1];
+  CeedScalar (*rhs)[Q] = (CeedScalar (*)[Q])out[2];
+  const CeedScalar (*x)[Q] = (const CeedScalar (*)[Q])in[0];
+  const CeedScalar (*J)[3][Q] = (const CeedScalar (*)[3][Q])in[1];
+  const CeedScalar *w = in[2];
+  for (CeedInt i=0; i<Q; i++) {
+    // M[c][d] = dx_c/dxi_d; the gradient is stored as J[d][c]
+    CeedScalar M[3][3], A[3][3];
+    for (int c=0; c<3; c++)
+      for (int d=0; d<3; d++)
+        M[c][d] = J[d][c][i];
+    // A = adj(M)
+    A[0][0] = M[1][1]*M[2][2] - M[1][2]*M[2][1];
+    A[0][1] = M[0][2]*M[2][1] - M[0][1]*M[2][2];
+    A[0][2] = M[0][1]*M[1][2] - M[0][2]*M[1][1];
+    A[1][0] = M[1][2]*M[2][0] - M[1][0]*M[2][2];
+    A[1][1] = M[0][0]*M[2][2] - M[0][2]*M[2][0];
+    A[1][2] = M[0][2]*M[1][0] - M[0][0]*M[1][2];
+    A[2][0] = M[1][0]*M[2][1] - M[1][1]*M[2][0];
+    A[2][1] = M[0][1]*M[2][0] - M[0][0]*M[2][1];
+    A[2][2] = M[0][0]*M[1][1] - M[0][1]*M[1][0];
+    const CeedScalar det = M[0][0]*A[0][0] + M[0][1]*A[1][0] + M[0][2]*A[2][0];
+    const CeedScalar s = w[i] / det;
+    const int voigt[6][2] = {{0,0}, {1,1}, {2,2}, {1,2}, {0,2}, {0,1}};
+    for (int v=0; v<6; v++) {
+      const int r = voigt[v][0], t = voigt[v][1];
+      qd[v][i] = s * (A[r][0]*A[t][0] + A[r][1]*A[t][1] + A[r][2]*A[t][2]);
+    }
+    const CeedScalar xi[3] = {x[0][i], x[1][i], x[2][i]};
+    for (CeedInt c=0; c<ncomp; c++) {
+      true_soln[c][i] = DiffSolution(xi, c);
+      rhs[c][i] = w[i] * det * 14 * PETSC_PI * PETSC_PI * true_soln[c][i];
+    }
   }
   return 0;
 }
@@ -50,11 +116,77 @@ static int Mass(void *ctx, CeedInt Q,
   return 0;
 }
 
+static int Mass3(void *ctx, CeedInt Q,
+                 const CeedScalar *const *in, CeedScalar *const *out) {
+  const CeedScalar (*u)[Q] = (const CeedScalar (*)[Q])in[0];
+  const CeedScalar *rho = in[1];
+  CeedScalar (*v)[Q] = (CeedScalar (*)[Q])out[0];
+  for (CeedInt i=0; i<Q; i++) {
+    v[0][i] = rho[i] * u[0][i];
+    v[1][i] = rho[i] * u[1][i];
+    v[2][i] = rho[i] * u[2][i];
+  }
+  return 0;
+}
+
+// Mass operator with the geometric factor det(J)*w recomputed from the
+// coordinate Jacobian at each application, instead of being stored
+static int MassOnTheFly(void *ctx, CeedInt Q,
+                        const CeedScalar *const *in, CeedScalar *const *out) {
+  const CeedInt ncomp = *(const CeedInt *)ctx;
+  const CeedScalar (*u)[Q] = (const CeedScalar (*)[Q])in[0];
+  const CeedScalar (*J)[3][Q] = (const CeedScalar (*)[3][Q])in[1];
+  const CeedScalar *w = in[2];
+  CeedScalar (*v)[Q] = (CeedScalar (*)[Q])out[0];
+  for (CeedInt i=0; i<Q; i++) {
+    const CeedScalar det =
+      (+ J[0][0][i] * (J[1][1][i]*J[2][2][i] - J[1][2][i]*J[2][1][i])
+       - J[0][1][i] * (J[1][0][i]*J[2][2][i] - J[1][2][i]*J[2][0][i])
+       + J[0][2][i] * (J[1][0][i]*J[2][1][i] - J[1][1][i]*J[2][0][i]));
+    const CeedScalar rho = det * w[i];
+    for (CeedInt c=0; c<ncomp; c++)
+      v[c][i] = rho * u[c][i];
+  }
+  return 0;
+}
+
+// The gradients are stored as [dim][ncomp][Q]
+static int Diff(void *ctx, CeedInt Q,
+                const CeedScalar *const *in, CeedScalar *const *out) {
+  const CeedScalar (*ug)[Q] = (const CeedScalar (*)[Q])in[0];
+  const CeedScalar (*qd)[Q] = (const CeedScalar (*)[Q])in[1];
+  CeedScalar (*vg)[Q] = (CeedScalar (*)[Q])out[0];
+  for (CeedInt i=0; i<Q; i++) {
+    const CeedScalar du[3] = {ug[0][i], ug[1][i], ug[2][i]};
+    vg[0][i] = qd[0][i]*du[0] + qd[5][i]*du[1] + qd[4][i]*du[2];
+    vg[1][i] = qd[5][i]*du[0] + qd[1][i]*du[1] + qd[3][i]*du[2];
+    vg[2][i] = qd[4][i]*du[0] + qd[3][i]*du[1] + qd[2][i]*du[2];
+  }
+  return 0;
+}
+
+static int Diff3(void *ctx, CeedInt Q,
+                 const CeedScalar *const *in, CeedScalar *const *out) {
+  const CeedScalar (*ug)[3][Q] = (const CeedScalar (*)[3][Q])in[0];
+  const CeedScalar (*qd)[Q] = (const CeedScalar (*)[Q])in[1];
+  CeedScalar (*vg)[3][Q] = (CeedScalar (*)[3][Q])out[0];
+  for (CeedInt i=0; i<Q; i++) {
+    for (CeedInt c=0; c<3; c++) {
+      const CeedScalar du[3] = {ug[0][c][i], ug[1][c][i], ug[2][c][i]};
+      vg[0][c][i] = qd[0][i]*du[0] + qd[5][i]*du[1] + qd[4][i]*du[2];
+      vg[1][c][i] = qd[5][i]*du[0] + qd[1][i]*du[1] + qd[3][i]*du[2];
+      vg[2][c][i] = qd[4][i]*du[0] + qd[3][i]*du[1] + qd[2][i]*du[2];
+    }
+  }
+  return 0;
+}
+
 static int Error(void *ctx, CeedInt Q,
                  const CeedScalar *const *in, CeedScalar *const *out) {
+  const CeedInt ncomp = *(const CeedInt *)ctx;
   const CeedScalar *u = in[0], *target = in[1];
   CeedScalar *err = out[0];
-  for (CeedInt i=0; i<Q; i++) {
+  for (CeedInt i=0; i<ncomp*Q; i++) {
     err[i] = u[i] - target[i];
   }
   return 0;
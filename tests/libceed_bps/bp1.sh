@@ -24,7 +24,7 @@ function build_tests()
    $dry_run make \
       CEED_DIR="${LIBCEED_DIR}" \
       BLD="${test_exe_dir}/" \
-      OPT="$NATIVE_CFLAG" \
+      OPT="$NATIVE_CFLAG${openmp:+ ${OPENMP_CFLAG:--fopenmp}}" \
       -j $num_proc_build
 }
 
@@ -36,15 +36,46 @@ function run_tests()
    $dry_run cd "$test_exe_dir"
 
    # Some of the available options are:
+   # -problem <1>: CEED benchmark problem, 1-6
    # -degree <1>: Polynomial degree of tensor product basis
    # -qextra <2>: Number of extra quadrature points
    # -ceed </cpu/self>: CEED resource specifier
    # -local <1000>: Target number of locally (per rank) owned degrees of freedom
+   # -overlap: Overlap the MatMult communication with the interior elements
+   # -structured: Structured element restriction, without an index array
+   # -onthefly: Mass operator computing its geometric factors in each apply
+   # -threads <1>: Number of OpenMP threads, each applying the operator on a
+   #    slab of the local elements
+   # -preconditioner <none>: none, jacobi, or chebyshev (Chebyshev-Jacobi),
+   #    using the diagonal of the operator
+   # -chebyshev_its <3>: Chebyshev iterations per preconditioner application
+   # -log_view: PETSc log with the stages (setup, restriction build, qfunction
+   #    setup, solve) and the MatMult events (scatters, CEED apply, zeroing)
+   # -bind: Bind the local vectors to the CeedVectors once, at setup
+   # -ceed_list <r1,r2,...>: Compare several CEED resources in one run
+   # -nmult <0>: Number of timed operator applies per CEED resource
+   # -backend_tol <1e-6>: Tolerance for the difference from the first resource
 
-   # The variables 'ceed', 'max_dofs_node', and 'max_p' can be set on the
-   # command line invoking the '../../go.sh' script.
+   # The variables 'ceed', 'ceed_list', 'nmult', 'max_dofs_node', 'max_p',
+   # 'overlap', 'bind', 'structured', 'onthefly', 'openmp', 'preconditioner',
+   # and 'log_view' can be set on the command line invoking the '../../go.sh'
+   # script. The variable 'problem' is set by the scripts
+   # bp2.sh, ..., bp6.sh.
    local ceed="${ceed:-/cpu/self}"
-   local common_args=(-ceed $ceed -qextra 2 -pc_type none)
+   local problem="${problem:-1}"
+   # number of components: 1 for the odd BPs, 3 for the even BPs
+   local vdim=$(( problem % 2 ? 1 : 3 ))
+   local preconditioner="${preconditioner:-none}"
+   local common_args=(-ceed $ceed -problem $problem -qextra 2
+                      -preconditioner $preconditioner)
+   [[ -n "$overlap" ]] && common_args+=(-overlap)
+   [[ -n "$bind" ]] && common_args+=(-bind)
+   [[ -n "$structured" ]] && common_args+=(-structured)
+   [[ -n "$onthefly" ]] && common_args+=(-onthefly)
+   [[ -n "$openmp" ]] && common_args+=(-threads ${OMP_NUM_THREADS:-1})
+   [[ -n "$log_view" ]] && common_args+=(-log_view)
+   [[ -n "$ceed_list" ]] && common_args+=(-ceed_list $ceed_list)
+   [[ -n "$nmult" ]] && common_args+=(-nmult $nmult)
    local max_dofs_node_def=$((3*2**20))
    local max_dofs_node=${max_dofs_node:-$max_dofs_node_def}
    local max_loc_dofs=$((max_dofs_node/num_proc_node))
@@ -52,8 +83,8 @@ function run_tests()
    local sol_p=
    for ((sol_p = 1; sol_p <= max_p; sol_p++)); do
       local loc_el=
-      for ((loc_el = 1; loc_el*sol_p**3 <= max_loc_dofs; loc_el = 2*loc_el)); do
-         local loc_dofs=$((loc_el*sol_p**3))
+      for ((loc_el = 1; loc_el*sol_p**3*vdim <= max_loc_dofs; loc_el = 2*loc_el)); do
+         local loc_dofs=$((loc_el*sol_p**3*vdim))
          local all_args=("${common_args[@]}" -degree $sol_p -local $loc_dofs)
          if [ -z "$dry_run" ]; then
             echo
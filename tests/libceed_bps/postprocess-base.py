@@ -96,6 +96,12 @@ while True:
       elif 'DOFs/sec in CG :' in line:
          # out.write(lnfmt%i+': %s'%line)
          data['cg-iteration-dps']=1e6*float(line.split(' ')[4])
+      elif 'DOFs/sec in apply    :' in line:
+         # out.write(lnfmt%i+': %s'%line)
+         data['apply-dps']=1e6*float(line.split()[4])
+      elif 'Scatter setup time:' in line:
+         # out.write(lnfmt%i+': %s'%line)
+         data['scatter-setup-time']=float(line.split(' ')[3])
       elif 'Global dofs:' in line:
          # out.write(lnfmt%i+': %s'%line)
          data['num-unknowns']=long(line.rsplit(None,1)[1])
@@ -106,6 +112,8 @@ while True:
    elif state==3:
       ##
       parts=line.split()
+      data['problem']=1
+      data['num-threads']=1
       i=0
       while i < len(parts):
          if parts[i]=='-qextra':
@@ -117,8 +125,18 @@ while True:
          elif parts[i]=='-ceed':
             i=i+1
             data['ceed']=parts[i]
+         elif parts[i]=='-threads':
+            i=i+1
+            data['num-threads']=int(parts[i])
+         elif parts[i]=='-problem':
+            i=i+1
+            data['problem']=int(parts[i])
          i=i+1
-      qpts=data['quadrature-pts']+data['order']
+      if data['problem'] in (5,6):
+         # BP5 and BP6 use collocated quadrature: Q=P
+         qpts=data['order']+1
+      else:
+         qpts=data['quadrature-pts']+data['order']
       data['quadrature-pts']=qpts**3
       state=1
 
@@ -0,0 +1,173 @@
+# Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+# the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+# reserved. See files LICENSE and NOTICE for details.
+#
+# This file is part of CEED, a collection of benchmarks, miniapps, software
+# libraries and APIs for efficient high-order finite element and spectral
+# element discretizations for exascale applications. For more information and
+# source code availability see http://github.com/ceed.
+#
+# The CEED research is supported by the Exascale Computing Project
+# (17-SC-20-SC), a collaborative effort of two U.S. Department of Energy
+# organizations (Office of Science and the National Nuclear Security
+# Administration) responsible for the planning and preparation of a capable
+# exascale ecosystem, including software, applications, hardware, advanced
+# system engineering and early testbed platforms, in support of the nation's
+# exascale computing imperative.
+
+if [[ -z "$root_dir" ]]; then
+   echo "This script ($0) should not be called directly. Stop."
+   return 1
+fi
+
+# Autotuner for the compile-time parameters of bp1_v1.cpp on the current
+# machine. For a given problem, vdim, order (sol_p) and local problem size
+# (local_dofs, per MPI task), and for each quadrature type (ir_type) and vector
+# layout (vec_layout, for vdim > 1), every combination of element batch size
+# (batch_size) and compiler flags (TEST_EXTRA_CFLAGS_LIST from the machine
+# config, default: TEST_EXTRA_CFLAGS) is built and the operator apply is timed.
+# The fastest combination for each (ir_type, vec_layout) is stored in the
+# per-machine cache $OUT_DIR/autotune-cache.sh, which go.sh reads, so that
+# later runs of bp*_v1.sh with autotune=yes and the same config and compiler
+# use it. Example:
+#
+#   ../../go.sh -c linux -m gcc -r autotune.sh -n 16 -p 16 \
+#      problem=0 vdim=3 sol_p=4 local_dofs=200000
+#
+# The search lists can be set on the command line, e.g. batch_size_list="1 4".
+
+tune_sol_p=${sol_p:-3}
+source ${root_dir}/tests/mfem_bps/bp1_v1.sh
+
+
+function configure_autotune()
+{
+   configure_tests || return 1
+   sol_p_list=($tune_sol_p)
+   ir_order_list=(0)
+   local_dofs=${local_dofs:-$((2**17))}
+   max_approx_dofs=$(( local_dofs*num_proc_run ))
+   num_mult=${num_mult:-20}
+   ir_type_list=(${ir_type_list:-0 1})
+   if (( vdim > 1 )); then
+      vec_layout_list=(${vec_layout_list:-Ordering::byVDIM Ordering::byNODES AoSoA})
+   else
+      vec_layout_list=("")
+   fi
+   batch_size_list=(${batch_size_list:-1 2 4 8})
+   if [[ "${#TEST_EXTRA_CFLAGS_LIST[@]}" -eq 0 ]]; then
+      TEST_EXTRA_CFLAGS_LIST=("$TEST_EXTRA_CFLAGS")
+   fi
+   # the cached parameters must not replace the ones being tuned, and the
+   # variants are always rebuilt since the flags may have changed
+   autotune=no
+   multi_order=no
+   rebuild_tests=yes
+   autotune_cache="$OUT_DIR/autotune-cache.sh"
+}
+
+
+function run_autotune_variant()
+{
+   # Build and run the current variant; sets 'variant_dofs_sec'
+   local out=
+   variant_dofs_sec=""
+   default_ir_type="$ir_type"
+   default_vec_layout="$vec_layout"
+   default_batch_size="$batch_size"
+   $dry_run cd "$test_dir"
+   TEST_EXTRA_CFLAGS="$variant_cflags" build_tests 0 || return 1
+   $dry_run cd "$test_exe_dir"
+   (( mesh_s_shift = 0 ))
+   set_test_params 0 || return 1
+   set_mpi_options
+   local all_args=(-no-vis $mesh_opt -rs $ser_ref -rp $par_ref -pc none
+                   -o $sol_p -irt $ir_type -perf -mf -mi 1 -nmult $num_mult
+                   "${test_extra_args[@]}")
+   echo "Running variant:"
+   quoted_echo $mpi_run ./${test_name}$suffix "${all_args[@]}"
+   [[ -n "$dry_run" ]] && return 0
+   out="$($mpi_run ./${test_name}$suffix "${all_args[@]}")" || return 1
+   variant_dofs_sec="$(printf "%s\n" "$out" |
+      sed -n -e 's/^"DOFs\/sec" in operator apply: \([^ ]*\) .*$/\1/p')"
+   echo "   \"DOFs/sec\" in operator apply: $variant_dofs_sec million"
+}
+
+
+function save_autotune_result()
+{
+   # Replace the entry for (problem, vdim, sol_p, ir_type, vec_layout) in the
+   # autotune cache
+   local pfx="$(autotune_prefix $tune_sol_p)"
+   local batch_size="$best_batch_size" cflags="$best_cflags"
+   local dofs_sec="$best_dofs_sec" local_dofs="$local_dofs"
+   if [[ -e "$autotune_cache" ]]; then
+      grep -v "^${pfx}" "$autotune_cache" > "${autotune_cache}.tmp"
+   else
+      echo "# Autotuned parameters for bp1_v1.cpp, see tests/mfem_bps/autotune.sh" \
+         > "${autotune_cache}.tmp"
+   fi
+   print_variables "$pfx" batch_size cflags dofs_sec local_dofs \
+      >> "${autotune_cache}.tmp"
+   mv -f "${autotune_cache}.tmp" "$autotune_cache"
+   echo "Saved the autotuned parameters in $autotune_cache"
+}
+
+
+function build_and_run_tests()
+{
+   $dry_run cd "$test_dir"
+   configure_autotune || return 1
+
+   local it= vl= bs= cf=
+   for it in "${ir_type_list[@]}"; do
+      for vl in "${vec_layout_list[@]}"; do
+         # ir_type and vec_layout define the benchmark: tune the batch size
+         # and the flags separately for each of them
+         best_dofs_sec=""
+         for bs in "${batch_size_list[@]}"; do
+            for ((cf = 0; cf < ${#TEST_EXTRA_CFLAGS_LIST[@]}; cf++)); do
+               ir_type="$it"
+               vec_layout="$vl"
+               batch_size="$bs"
+               variant_cflags="${TEST_EXTRA_CFLAGS_LIST[cf]}"
+               suffix_extra="_c${cf}"
+               echo
+               echo "Variant: ir_type=$it vec_layout=${vl:-(scalar)}" \
+                    "batch_size=$bs cflags=\"$variant_cflags\""
+               run_autotune_variant || {
+                  echo "   Variant failed, skipping it."
+                  continue
+               }
+               [[ -n "$variant_dofs_sec" ]] || continue
+               if [[ -z "$best_dofs_sec" ]] || \
+                  awk "BEGIN{exit !($variant_dofs_sec > $best_dofs_sec)}"; then
+                  best_dofs_sec="$variant_dofs_sec"
+                  best_batch_size="$bs"
+                  best_cflags="$variant_cflags"
+               fi
+            done
+         done
+         suffix_extra=""
+         [[ -n "$dry_run" ]] && continue
+         [[ -n "$best_dofs_sec" ]] || {
+            echo "No successful variant for ir_type=$it" \
+                 "vec_layout=${vl:-(scalar)}."
+            continue
+         }
+         ir_type="$it"
+         vec_layout="$vl"
+         echo
+         echo "Best variant for problem=$problem vdim=$vdim sol_p=$tune_sol_p" \
+              "ir_type=$it vec_layout=${vl:-(scalar)} local_dofs=$local_dofs:"
+         echo "   batch_size=$best_batch_size cflags=\"$best_cflags\""
+         echo "   \"DOFs/sec\" in operator apply: $best_dofs_sec million"
+         save_autotune_result
+      done
+   done
+
+   $dry_run make -f "$test_dir/makefile" clean-exec
+}
+
+
+test_required_packages="metis hypre mfem"
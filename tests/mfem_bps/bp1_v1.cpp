@@ -46,10 +46,6 @@ using namespace mfem;
 #define MESH_P 3
 #endif
 
-#ifndef SOL_P
-#define SOL_P 3
-#endif
-
 #ifndef IR_ORDER
 #define IR_ORDER 0
 #endif
@@ -67,18 +63,51 @@ using namespace mfem;
 #define VDIM 1
 #endif
 
-// This vector layout is used for the solution space only.
+// This vector layout is used for the solution space only: Ordering::byVDIM,
+// Ordering::byNODES or AoSoA (see AoSoALayout below).
 #ifndef VEC_LAYOUT
 #define VEC_LAYOUT Ordering::byVDIM
 #endif
 
+// Number of nodes per component chunk in the AoSoA layout; typically the SIMD
+// width in doubles.
+#ifndef AOSOA_BLOCK
+#define AOSOA_BLOCK 8
+#endif
+
+// Number of elements processed together by the templated operator; when not
+// defined, the default of MFEM's AutoSIMDTraits is used.
+// #define BATCH_SIZE 1
+
+// Solution orders and quadrature types compiled into the executable, as a list
+// of BP1_INSTANCE(sol_p, ir_type, ir_order) entries (ir_order 0 - derived from
+// sol_p and ir_type); the instance is selected at run time with --order and
+// --ir-type. By default, only the instance for SOL_P (default: 3), IR_TYPE and
+// IR_ORDER is built. BP1_INSTANCE_LIST, e.g. set by the makefile with
+// multi_order=1, gives the list explicitly, and MULTI_ORDER selects the grid of
+// all orders and quadrature types.
+#if defined(BP1_INSTANCE_LIST)
+#define BP1_INSTANCES BP1_INSTANCE_LIST
+#elif !defined(MULTI_ORDER)
+#ifndef SOL_P
+#define SOL_P 3
+#endif
+#define BP1_INSTANCES BP1_INSTANCE(SOL_P,IR_TYPE,IR_ORDER)
+#else
+#define BP1_INSTANCES \
+   BP1_INSTANCE(1,0,0) BP1_INSTANCE(2,0,0) BP1_INSTANCE(3,0,0) \
+   BP1_INSTANCE(4,0,0) BP1_INSTANCE(5,0,0) BP1_INSTANCE(6,0,0) \
+   BP1_INSTANCE(7,0,0) BP1_INSTANCE(8,0,0) BP1_INSTANCE(9,0,0) \
+   BP1_INSTANCE(10,0,0) BP1_INSTANCE(11,0,0) BP1_INSTANCE(12,0,0) \
+   BP1_INSTANCE(1,1,0) BP1_INSTANCE(2,1,0) BP1_INSTANCE(3,1,0) \
+   BP1_INSTANCE(4,1,0) BP1_INSTANCE(5,1,0) BP1_INSTANCE(6,1,0) \
+   BP1_INSTANCE(7,1,0) BP1_INSTANCE(8,1,0) BP1_INSTANCE(9,1,0) \
+   BP1_INSTANCE(10,1,0) BP1_INSTANCE(11,1,0) BP1_INSTANCE(12,1,0)
+#endif
+
 // Define template parameters for optimized build.
 const Geometry::Type geom     = GEOM;      // mesh elements  (default: hex)
 const int            mesh_p   = MESH_P;    // mesh curvature (default: 3)
-const int            sol_p    = SOL_P;     // solution order (default: 3)
-const int            ir_q     = IR_TYPE ? sol_p+1 : sol_p+2;
-const int            ir_order = IR_ORDER ? IR_ORDER :
-                                (IR_TYPE ? 2*ir_q-3 : 2*ir_q-1);
 
 
 // Workaround for a bug in XL C++ on BG/Q version 12.01.0000.0014
@@ -93,6 +122,9 @@ template class StridedLayout1D<mesh_dim*VDIM,1>;
 
 
 #include <mfem-performance.hpp>
+#include <cg-solvers.hpp>
+#include <element-subset.hpp>
+#include <heap-counter.hpp>
 #include <fstream>
 #include <iostream>
 
@@ -141,18 +173,61 @@ typedef H1_FiniteElement<geom,mesh_p>         mesh_fe_t;
 typedef H1_FiniteElementSpace<mesh_fe_t>      mesh_fes_t;
 typedef TMesh<mesh_fes_t>                     mesh_t;
 
-// Static solution finite element space type
-typedef H1_FiniteElement<geom,sol_p>          sol_fe_t;
-typedef H1_FiniteElementSpace<sol_fe_t>       sol_fes_t;
+// Blocked array-of-structs-of-arrays vector layout: the nodes are grouped in
+// chunks of Block consecutive nodes and each chunk stores its NumComp
+// components one after the other, i.e. [x0..x7 y0..y7 z0..z7 x8..x15 ...] for
+// Block = 8. Every component of a chunk is contiguous (for SIMD over nodes)
+// while all components of a node are close (one gather per chunk instead of
+// one per component). The last chunk may be shorter than Block. The finite
+// element space uses Ordering::byNODES; the permutation of the local vectors
+// is applied through the prolongation, see FormAoSoALinearSystem().
+const int AoSoA = 2;
+
+template <int NumComp, int Block>
+class AoSoALayout
+{
+protected:
+   int num_dofs;
 
-// Static quadrature, coefficient and integrator types
-#if (IR_TYPE == 0)
-typedef TIntegrationRule<geom,ir_order>       int_rule_t;
-#else
-const int rdim = Geometry::Constants<geom>::Dimension;
-typedef GaussLobattoIntegrationRule<rdim,ir_order/2+2,double>
-                                              int_rule_t;
-#endif
+public:
+   static const int vec_dim = NumComp;
+
+   AoSoALayout(int num_dofs_) : num_dofs(num_dofs_) { }
+
+   AoSoALayout(const FiniteElementSpace &fes) : num_dofs(fes.GetNDofs())
+   {
+      MFEM_ASSERT(Matches(fes), "invalid space for the AoSoA layout");
+   }
+
+   int NumComponents() const { return NumComp; }
+
+   int ind(int scal_idx, int comp) const
+   {
+      const int start = scal_idx - scal_idx % Block;
+      const int len = std::min(Block, num_dofs - start);
+      return start*NumComp + comp*len + scal_idx % Block;
+   }
+
+   static bool Matches(const FiniteElementSpace &fes)
+   {
+      return (fes.GetOrdering() == Ordering::byNODES &&
+              fes.GetVDim() == NumComp);
+   }
+};
+
+// Vector layout type for the VEC_LAYOUT option
+template <int Ord, int NumComp>
+struct VecLayoutType
+{
+   typedef VectorLayout<(Ordering::Type)Ord,NumComp> type;
+};
+template <int NumComp>
+struct VecLayoutType<AoSoA,NumComp>
+{
+   typedef AoSoALayout<NumComp,AOSOA_BLOCK> type;
+};
+
+// Static coefficient, integrator and vector layout types
 typedef TConstantCoefficient<>                coeff_t;
 #if (PROBLEM == 0)
 typedef TIntegrator<coeff_t,TDiffusionKernel> integ_t;
@@ -162,12 +237,197 @@ typedef TIntegrator<coeff_t,TMassKernel> integ_t;
 #if (VDIM == 1)
 typedef ScalarLayout                          vec_layout_t;
 #else
-typedef VectorLayout<VEC_LAYOUT,VDIM>         vec_layout_t;
+typedef VecLayoutType<VEC_LAYOUT,VDIM>::type  vec_layout_t;
+#endif
+
+// Static quadrature type: 0 - Gauss, 1 - Gauss-Lobatto
+const int rdim = Geometry::Constants<geom>::Dimension;
+template <int IR_T, int IR_ORD>
+struct IntRuleType
+{
+   typedef TIntegrationRule<geom,IR_ORD> type;
+};
+template <int IR_ORD>
+struct IntRuleType<1,IR_ORD>
+{
+   typedef GaussLobattoIntegrationRule<rdim,IR_ORD/2+2,double> type;
+};
+
+// Implementation traits of the templated operator, with the element batch size
+// overridden by BATCH_SIZE
+#ifdef BATCH_SIZE
+struct BatchSIMDTraits : public AutoSIMDTraits<double,double>
+{
+   static const int batch_size = BATCH_SIZE;
+};
+typedef BatchSIMDTraits                       impl_traits_t;
+#else
+typedef AutoSIMDTraits<double,double>         impl_traits_t;
+#endif
+
+// Static solution finite element space, quadrature and bilinear form types for
+// solution order SOL_ORDER, quadrature type IR_T and integration rule order
+// IR_ORD (0 - derived from SOL_ORDER and IR_T)
+template <int SOL_ORDER, int IR_T, int IR_ORD>
+struct HPCTypes
+{
+   static const int sol_p    = SOL_ORDER;
+   static const int ir_q     = IR_T ? sol_p+1 : sol_p+2;
+   static const int ir_order = IR_ORD ? IR_ORD :
+                               (IR_T ? 2*ir_q-3 : 2*ir_q-1);
+
+   typedef H1_FiniteElement<geom,sol_p>                 sol_fe_t;
+   typedef H1_FiniteElementSpace<sol_fe_t>              sol_fes_t;
+   typedef typename IntRuleType<IR_T,ir_order>::type    int_rule_t;
+
+   // Static bilinear form type, combining the above types
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,integ_t,
+           vec_layout_t,double,double,impl_traits_t> HPCBilinearForm;
+};
+
+// Interface to an instance of the templated bilinear form, selected at run time
+// from the registry below. The operator action is that of the templated form.
+class HPCForm
+{
+public:
+   virtual Operator &GetOperator() = 0;
+   virtual void Assemble() = 0;
+   virtual void AssembleBilinearForm(BilinearForm &a) const = 0;
+   // Used by the element subset operators, see element-subset.hpp
+   void Mult(const Vector &x, Vector &y) { GetOperator().Mult(x, y); }
+   virtual ~HPCForm() { }
+};
+
+template <int SOL_ORDER, int IR_T, int IR_ORD>
+class HPCFormInstance : public HPCForm
+{
+protected:
+   typedef HPCTypes<SOL_ORDER,IR_T,IR_ORD> types;
+   typename types::HPCBilinearForm form;
+
+public:
+   HPCFormInstance(const FiniteElementSpace &fes)
+      : form(integ_t(coeff_t(1.0)), fes) { }
+
+   virtual Operator &GetOperator() { return form; }
+   virtual void Assemble() { form.Assemble(); }
+   virtual void AssembleBilinearForm(BilinearForm &a) const
+   { form.AssembleBilinearForm(a); }
+
+   static int GetNumQuadPoints() { return types::int_rule_t::qpts; }
+   static bool Matches(const FiniteElementSpace &fes)
+   { return types::sol_fes_t::Matches(fes); }
+   static HPCForm *Create(const FiniteElementSpace &fes)
+   { return new HPCFormInstance(fes); }
+};
+
+// Registry of the compiled bilinear form instances
+struct HPCFormEntry
+{
+   int sol_p, ir_type;
+   int (*num_qpts)();
+   bool (*matches)(const FiniteElementSpace &);
+   HPCForm *(*create)(const FiniteElementSpace &);
+};
+#define BP1_INSTANCE(p,t,q) \
+   { p, t, HPCFormInstance<p,t,q>::GetNumQuadPoints, \
+     HPCFormInstance<p,t,q>::Matches, HPCFormInstance<p,t,q>::Create },
+const HPCFormEntry hpc_registry[] = { BP1_INSTANCES };
+#undef BP1_INSTANCE
+const int hpc_num_instances = sizeof(hpc_registry)/sizeof(hpc_registry[0]);
+
+// Bilinear form instance with the threaded element loop (see element-subset.hpp)
+// for the partially assembled operator. The full (unthreaded) instance is only
+// used for the assembly of matrices, e.g. for the HO preconditioner.
+class ThreadedHPCForm : public HPCForm
+{
+protected:
+   HPCForm *full;
+   ThreadedElementOperator<HPCForm> oper;
+
+public:
+   ThreadedHPCForm(const HPCFormEntry &entry, ParFiniteElementSpace &pfes)
+      : full(entry.create(pfes)), oper(pfes, entry.create) { }
+
+   virtual Operator &GetOperator() { return oper; }
+   virtual void Assemble() { oper.Assemble(); }
+   virtual void AssembleBilinearForm(BilinearForm &a) const
+   { full->AssembleBilinearForm(a); }
+
+   const ThreadedElementOperator<HPCForm> &GetThreadedOperator() const
+   { return oper; }
+
+   virtual ~ThreadedHPCForm() { delete full; }
+};
+
+// Time 'num_applies' applications of the local (L-vector) operator 'op' after
+// one warm-up application. No communication is involved, so the partially
+// assembled and the assembled CSR representations are compared on equal terms.
+// Returns the maximum over all ranks of the time per application.
+double TimeLocalApply(const Operator &op, int num_applies, MPI_Comm comm)
+{
+   Vector x(op.Width()), y(op.Height());
+   x = 1.0;
+   op.Mult(x, y); // warm-up
+   MPI_Barrier(comm);
+#ifdef USE_MPI_WTIME
+   double my_rt_start = MPI_Wtime();
+#else
+   tic_toc.Clear();
+   tic_toc.Start();
 #endif
+   for (int i = 0; i < num_applies; i++)
+   {
+      op.Mult(x, y);
+   }
+#ifdef USE_MPI_WTIME
+   double my_rt = MPI_Wtime() - my_rt_start;
+#else
+   tic_toc.Stop();
+   double my_rt = tic_toc.RealTime();
+#endif
+   double rt_max;
+   MPI_Allreduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, comm);
+   return rt_max/num_applies;
+}
 
-// Static bilinear form type, combining the above types
-typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,integ_t,
-        vec_layout_t> HPCBilinearForm;
+// Form the true dof linear system for the operator 'form' acting on local
+// vectors in the AoSoA layout, given the byNODES grid functions x and b. The
+// rows of the prolongation are permuted to the AoSoA layout, so that the
+// permutation is applied inside the prolongation instead of as a separate
+// pass. Returns the constrained operator; 'P_aosoa' must be kept until the
+// operator is deleted.
+Operator *FormAoSoALinearSystem(ParFiniteElementSpace &fes, Operator &form,
+                                const Array<int> &ess_tdof_list,
+                                const Vector &x, const Vector &b,
+                                Vector &X, Vector &B, HypreParMatrix *&P_aosoa)
+{
+   const int num_dofs = fes.GetNDofs(), vdim = fes.GetVDim();
+   typedef AoSoALayout<VDIM,AOSOA_BLOCK> aosoa_layout_t;
+   const aosoa_layout_t layout(num_dofs);
+   SparseMatrix perm(fes.GetVSize());
+   for (int j = 0; j < num_dofs; j++)
+   {
+      for (int k = 0; k < vdim; k++)
+      {
+         perm.Set(layout.ind(j, k), j + k*num_dofs, 1.0);
+      }
+   }
+   perm.Finalize();
+   HypreParMatrix Perm(fes.GetComm(), fes.GlobalVSize(), fes.GetDofOffsets(),
+                       &perm);
+   P_aosoa = ParMult(&Perm, fes.Dof_TrueDof_Matrix());
+
+   X.SetSize(fes.GetTrueVSize());
+   B.SetSize(fes.GetTrueVSize());
+   fes.GetRestrictionMatrix()->Mult(x, X);
+   fes.GetProlongationMatrix()->MultTranspose(b, B);
+   ConstrainedOperator *A =
+      new ConstrainedOperator(new RAPOperator(*P_aosoa, form, *P_aosoa),
+                              ess_tdof_list, true);
+   A->EliminateRHS(X, B);
+   return A;
+}
 
 int main(int argc, char *argv[])
 {
@@ -178,20 +438,30 @@ int main(int argc, char *argv[])
    MPI_Comm_rank(MPI_COMM_WORLD, &myid);
 
    const int            vdim     = VDIM;
-   const Ordering::Type ordering = VEC_LAYOUT; // for solution space only
+   // Ordering of the solution space only; the AoSoA layout uses a byNODES space
+   const bool aosoa = (vdim > 1 && VEC_LAYOUT == AoSoA);
+   const Ordering::Type ordering =
+      aosoa ? Ordering::byNODES : (Ordering::Type)VEC_LAYOUT;
 
    // 2. Parse command-line options.
    const char *mesh_file = "../../data/fichera.mesh";
    int ser_ref_levels = -1;
    int par_ref_levels = +1;
    Array<int> nxyz;
-   int order = sol_p;
+   int order = (hpc_num_instances == 1) ? hpc_registry[0].sol_p : 3;
+   int ir_type = IR_TYPE;
    const char *basis_type = "G"; // Gauss-Lobatto
    bool static_cond = false;
    const char *pc = "lor";
+   const char *solver = "cg";
    bool perf = true;
    bool matrix_free = true;
+   bool auto_select = false;
+   int num_auto_applies = 10;
+   bool threaded = false;
    int max_iter = 50;
+   int num_mult = 0;
+   int num_solves = 1;
    bool visualization = 1;
 
    OptionsParser args(argc, argv);
@@ -206,6 +476,9 @@ int main(int argc, char *argv[])
    args.AddOption(&order, "-o", "--order",
                   "Finite element order (polynomial degree) or -1 for"
                   " isoparametric space.");
+   args.AddOption(&ir_type, "-irt", "--ir-type",
+                  "Quadrature type of the high-performance version: "
+                  "0 - Gauss, 1 - Gauss-Lobatto.");
    args.AddOption(&basis_type, "-b", "--basis-type",
                   "Basis: G - Gauss-Lobatto, P - Positive, U - Uniform");
    args.AddOption(&perf, "-perf", "--hpc-version", "-std", "--standard-version",
@@ -213,13 +486,34 @@ int main(int argc, char *argv[])
    args.AddOption(&matrix_free, "-mf", "--matrix-free", "-asm", "--assembly",
                   "Use matrix-free evaluation or efficient matrix assembly in "
                   "the high-performance version.");
+   args.AddOption(&auto_select, "-auto", "--auto-select", "-no-auto",
+                  "--no-auto-select",
+                  "Build both the partially assembled and the assembled "
+                  "operator, time local applications of each and use the "
+                  "faster one (overrides --matrix-free/--assembly).");
+   args.AddOption(&num_auto_applies, "-nauto", "--num-auto-applies",
+                  "Number of timed local operator applications per "
+                  "representation used by --auto-select.");
+   args.AddOption(&threaded, "-omp", "--openmp", "-no-omp", "--no-openmp",
+                  "Use the OpenMP-threaded element loop, with OMP_NUM_THREADS "
+                  "threads per rank, for the matrix-free operator.");
    args.AddOption(&pc, "-pc", "--preconditioner",
                   "Preconditioner: lor - low-order-refined (matrix-free) AMG, "
                   "ho - high-order (assembled) AMG, none.");
+   args.AddOption(&solver, "-solver", "--solver",
+                  "Solver: cg - MFEM's CGSolver, "
+                  "cg-fused - CG with fused vector operations, "
+                  "cg-sr - single-reduction (Chronopoulos-Gear) CG.");
    args.AddOption(&static_cond, "-sc", "--static-condensation", "-no-sc",
                   "--no-static-condensation", "Enable static condensation.");
    args.AddOption(&max_iter, "-mi", "--max-iter",
                   "Maximum number of iterations.");
+   args.AddOption(&num_mult, "-nmult", "--num-mult",
+                  "Number of timed operator applications before the solve.");
+   args.AddOption(&num_solves, "-nsolves", "--num-solves",
+                  "Number of repeated solves with the same setup; the heap "
+                  "allocations of the first and of the later solves are "
+                  "reported.");
    args.AddOption(&visualization, "-vis", "--visualization", "-no-vis",
                   "--no-visualization",
                   "Enable or disable GLVis visualization.");
@@ -243,12 +537,30 @@ int main(int argc, char *argv[])
       MPI_Finalize();
       return 2;
    }
+   MFEM_VERIFY(!auto_select || (perf && !static_cond && !aosoa),
+               "--auto-select requires --hpc-version and is not compatible "
+               "with static condensation or the AoSoA layout");
+   MFEM_VERIFY(!auto_select || num_auto_applies >= 1,
+               "--num-auto-applies must be positive");
    MFEM_VERIFY(perf || !matrix_free,
                "--standard-version is not compatible with --matrix-free");
+   MFEM_VERIFY(!aosoa || (perf && matrix_free),
+               "the AoSoA layout requires --hpc-version and --matrix-free");
+   MFEM_VERIFY(!threaded || (perf && matrix_free && !auto_select && !aosoa),
+               "--openmp requires --hpc-version and --matrix-free, and is not "
+               "compatible with --auto-select or the AoSoA layout");
+#ifndef _OPENMP
+   if (threaded && myid == 0)
+   {
+      cout << "Warning: built without OpenMP, --openmp uses one thread per "
+           << "rank." << endl;
+   }
+#endif
    if (myid == 0)
    {
       args.PrintOptions(cout);
    }
+   MFEM_VERIFY(num_solves >= 1, "--num-solves must be positive");
 
    enum PCType { NONE, LOR, HO };
    PCType pc_choice;
@@ -260,6 +572,19 @@ int main(int argc, char *argv[])
       mfem_error("Invalid Preconditioner specified");
       return 3;
    }
+   MFEM_VERIFY(!aosoa || pc_choice != HO,
+               "the AoSoA layout does not support the HO preconditioner");
+
+   enum SolverType { CG, CG_FUSED, CG_SR };
+   SolverType solver_choice;
+   if (!strcmp(solver, "cg")) { solver_choice = CG; }
+   else if (!strcmp(solver, "cg-fused")) { solver_choice = CG_FUSED; }
+   else if (!strcmp(solver, "cg-sr")) { solver_choice = CG_SR; }
+   else
+   {
+      mfem_error("Invalid solver specified");
+      return 3;
+   }
 
    // See class BasisType in fem/fe_coll.hpp for available basis types
    int basis = BasisType::GetType(basis_type[0]);
@@ -267,6 +592,39 @@ int main(int argc, char *argv[])
    {
       cout << "Using " << BasisType::Name(basis) << " basis ..." << endl;
    }
+   if (myid == 0 && vdim > 1)
+   {
+      cout << "Vector layout: ";
+      if (aosoa) { cout << "AoSoA, block size " << AOSOA_BLOCK << endl; }
+      else { cout << (ordering == Ordering::byVDIM ? "byVDIM" : "byNODES") << endl; }
+   }
+
+   // Select the compiled bilinear form instance for the requested order and
+   // quadrature type
+   const HPCFormEntry *hpc_entry = NULL;
+   for (int i = 0; i < hpc_num_instances; i++)
+   {
+      if (hpc_registry[i].sol_p == order && hpc_registry[i].ir_type == ir_type)
+      {
+         hpc_entry = &hpc_registry[i];
+      }
+   }
+   if (perf && !hpc_entry)
+   {
+      if (myid == 0)
+      {
+         cout << "Order " << order << " with quadrature type " << ir_type
+              << " is not compiled in. Available (order, ir_type):";
+         for (int i = 0; i < hpc_num_instances; i++)
+         {
+            cout << " (" << hpc_registry[i].sol_p << ", "
+                 << hpc_registry[i].ir_type << ")";
+         }
+         cout << "\nRecompile with suitable 'sol_p' value." << endl;
+      }
+      MPI_Finalize();
+      return 5;
+   }
 
    // 3. Read the (serial) mesh from the given mesh file on all processors.  We
    //    can handle triangular, quadrilateral, tetrahedral, hexahedral, surface
@@ -280,9 +638,9 @@ int main(int argc, char *argv[])
       if (myid == 0)
       {
          cout << "High-performance version using integration rule with "
-              << int_rule_t::qpts << " points ..." << endl;
+              << hpc_entry->num_qpts() << " points ..." << endl;
          cout << "Quadrature rule type: "
-              << (IR_TYPE == 0 ? "Gauss" : "Gauss-Lobatto") << endl;
+              << (ir_type == 0 ? "Gauss" : "Gauss-Lobatto") << endl;
       }
       if (!mesh_t::MatchesGeometry(*mesh))
       {
@@ -331,7 +689,7 @@ int main(int argc, char *argv[])
    }
    if (!perf && mesh->NURBSext)
    {
-      const int new_mesh_p = std::min(sol_p, mesh_p);
+      const int new_mesh_p = std::min(order, mesh_p);
       if (myid == 0)
       {
          cout << "NURBS mesh: switching the mesh curvature to be "
@@ -416,7 +774,7 @@ int main(int argc, char *argv[])
    }
 
    // 8. Check if the optimized version matches the given space
-   if (perf && !sol_fes_t::Matches(*fespace))
+   if (perf && !hpc_entry->matches(*fespace))
    {
       if (myid == 0)
       {
@@ -502,8 +860,11 @@ int main(int argc, char *argv[])
    // allocation happens when a->Assemble() is called.
    a->UsePrecomputedSparsity();
 
-   HPCBilinearForm *a_hpc = NULL;
+   HPCForm *a_hpc = NULL;
+   ThreadedHPCForm *thr_hpc = NULL;
+   double my_rt_pa = 0.0, my_rt_asm = 0.0;
    Operator *a_oper = NULL;
+   HypreParMatrix *P_aosoa = NULL;
 
    if (!perf)
    {
@@ -521,8 +882,28 @@ int main(int argc, char *argv[])
    else
    {
       // High-performance assembly/evaluation using the templated operator type
-      a_hpc = new HPCBilinearForm(integ_t(coeff_t(1.0)), *fespace);
-      if (matrix_free)
+      if (threaded)
+      {
+         thr_hpc = new ThreadedHPCForm(*hpc_entry, *fespace);
+         a_hpc = thr_hpc;
+      }
+      else
+      {
+         a_hpc = hpc_entry->create(*fespace);
+      }
+      if (auto_select)
+      {
+         // build both representations, the faster one is selected below; the
+         // build of the other one is not part of the assembly time
+         double my_rt_part = MPI_Wtime();
+         a_hpc->Assemble();
+         my_rt_pa = MPI_Wtime() - my_rt_part;
+         my_rt_part = MPI_Wtime();
+         a_hpc->AssembleBilinearForm(*a);
+         a->Finalize();
+         my_rt_asm = MPI_Wtime() - my_rt_part;
+      }
+      else if (matrix_free)
       {
          a_hpc->Assemble(); // partial assembly
       }
@@ -539,6 +920,25 @@ int main(int argc, char *argv[])
    double rt_min, rt_max, my_rt;
    my_rt = tic_toc.RealTime();
 #endif
+
+   // Select the faster local operator representation for this order on this
+   // machine. The ratio of the two times shows how far the run is from the
+   // crossover between the assembled and the matrix-free operator (ratio 1).
+   // The probe, i.e. the build of the representation that is not used and the
+   // timed applications, is reported separately from the assembly.
+   double t_pa = 0.0, t_asm = 0.0, my_rt_probe = 0.0;
+   if (auto_select)
+   {
+      const double my_rt_probe_start = MPI_Wtime();
+      t_pa = TimeLocalApply(a_hpc->GetOperator(), num_auto_applies,
+                            pmesh->GetComm());
+      t_asm = TimeLocalApply(a->SpMat(), num_auto_applies, pmesh->GetComm());
+      matrix_free = (t_pa <= t_asm);
+      const double my_rt_unused = matrix_free ? my_rt_asm : my_rt_pa;
+      my_rt -= my_rt_unused;
+      my_rt_probe = my_rt_unused + (MPI_Wtime() - my_rt_probe_start);
+   }
+
    MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, pmesh->GetComm());
    MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
    if (myid == 0)
@@ -548,6 +948,46 @@ int main(int argc, char *argv[])
            << 1e-6*size/rt_max << " ("
            << 1e-6*size/rt_min << ") million.\n" << endl;
    }
+   if (auto_select)
+   {
+      double rt_probe;
+      MPI_Reduce(&my_rt_probe, &rt_probe, 1, MPI_DOUBLE, MPI_MAX, 0,
+                 pmesh->GetComm());
+      if (myid == 0)
+      {
+         cout << "Auto-selection, local apply time: partial assembly "
+              << t_pa << " s, assembled " << t_asm << " s." << endl;
+         cout << "Auto-selection, assembled/partial assembly time ratio: "
+              << t_asm/t_pa << endl;
+         cout << "Auto-selection, order " << order << ": using "
+              << (matrix_free ? "matrix-free evaluation" : "matrix assembly")
+              << "." << endl;
+         cout << "Auto-selection, probe time (not included in the assembly): "
+              << rt_probe << " s.\n" << endl;
+      }
+      if (matrix_free)
+      {
+         a->Update(); // the local matrix is not needed, free it
+      }
+   }
+   int num_threads = 1;
+   if (thr_hpc)
+   {
+      const ThreadedElementOperator<HPCForm> &thr_oper =
+         thr_hpc->GetThreadedOperator();
+      long loc_shared = thr_oper.GetNumSharedDofs(), glob_shared;
+      MPI_Reduce(&loc_shared, &glob_shared, 1, MPI_LONG, MPI_SUM, 0,
+                 pmesh->GetComm());
+      num_threads = thr_oper.GetNumThreads();
+      MPI_Allreduce(MPI_IN_PLACE, &num_threads, 1, MPI_INT, MPI_MAX,
+                    pmesh->GetComm());
+      if (myid == 0)
+      {
+         cout << "Threads per MPI rank: " << num_threads
+              << ", dofs on thread interfaces: " << glob_shared << "\n"
+              << endl;
+      }
+   }
 
    // 14. Define and apply a parallel PCG solver for AX=B with the BoomerAMG
    //     preconditioner from hypre.
@@ -567,7 +1007,16 @@ int main(int argc, char *argv[])
 #endif
    if (perf && matrix_free)
    {
-      a_hpc->FormLinearSystem(ess_tdof_list, x, *b, a_oper, X, B);
+      if (aosoa)
+      {
+         a_oper = FormAoSoALinearSystem(*fespace, a_hpc->GetOperator(),
+                                        ess_tdof_list, x, *b, X, B, P_aosoa);
+      }
+      else
+      {
+         a_hpc->GetOperator().FormLinearSystem(ess_tdof_list, x, *b, a_oper,
+                                               X, B);
+      }
       if (myid == 0)
       {
          cout << "Size of linear system: " << size << endl;
@@ -603,6 +1052,40 @@ int main(int argc, char *argv[])
            << 1e-6*size/rt_min << ") million.\n" << endl;
    }
 
+   // Time the operator apply alone (used by autotune.sh)
+   if (num_mult > 0)
+   {
+      Vector Y(B.Size());
+      a_oper->Mult(B, Y); // warm-up
+      MPI_Barrier(MPI_COMM_WORLD);
+#ifdef USE_MPI_WTIME
+      my_rt_start = MPI_Wtime();
+#else
+      tic_toc.Clear();
+      tic_toc.Start();
+#endif
+      for (int i = 0; i < num_mult; i++)
+      {
+         a_oper->Mult(B, Y);
+      }
+#ifdef USE_MPI_WTIME
+      my_rt = MPI_Wtime() - my_rt_start;
+#else
+      tic_toc.Stop();
+      my_rt = tic_toc.RealTime();
+#endif
+      MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, pmesh->GetComm());
+      MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+      if (myid == 0)
+      {
+         cout << "Operator apply time: " << rt_max / num_mult << " ("
+              << rt_min / num_mult << ") sec." << endl;
+         cout << "\n\"DOFs/sec\" in operator apply: "
+              << 1e-6*size*num_mult/rt_max << " ("
+              << 1e-6*size*num_mult/rt_min << ") million.\n" << endl;
+      }
+   }
+
    // Setup the matrix used for preconditioning
    if (myid == 0)
    {
@@ -658,8 +1141,21 @@ int main(int argc, char *argv[])
    }
 
    // Solve with CG or PCG, depending if the matrix A_pc is available
-   CGSolver *pcg;
-   pcg = new CGSolver(MPI_COMM_WORLD);
+   IterativeSolver *pcg;
+   FusedCGSolver *fcg = NULL;
+   SingleReductionCGSolver *srcg = NULL;
+   if (solver_choice == CG_FUSED)
+   {
+      pcg = fcg = new FusedCGSolver(MPI_COMM_WORLD);
+   }
+   else if (solver_choice == CG_SR)
+   {
+      pcg = srcg = new SingleReductionCGSolver(MPI_COMM_WORLD);
+   }
+   else
+   {
+      pcg = new CGSolver(MPI_COMM_WORLD);
+   }
    pcg->SetRelTol(1e-6);
    pcg->SetMaxIter(max_iter);
    pcg->SetPrintLevel(3);
@@ -678,6 +1174,10 @@ int main(int argc, char *argv[])
       pcg->SetPreconditioner(*amg);
    }
 
+   // Solve num_solves times with the same setup; the first solve includes any
+   // setup done lazily on first use, e.g. the AMG setup by hypre.
+   int cg_iters = 0;
+   long my_allocs[2] = { 0, 0 }; // first solve, later solves
 #ifdef USE_MPI_WTIME
    my_rt_start = MPI_Wtime();
 #else
@@ -685,7 +1185,14 @@ int main(int argc, char *argv[])
    tic_toc.Start();
 #endif
 
-   pcg->Mult(B, X);
+   for (int k = 0; k < num_solves; k++)
+   {
+      const long allocs_start = num_heap_allocs;
+      if (k > 0) { X = 0.0; }
+      pcg->Mult(B, X);
+      cg_iters += pcg->GetNumIterations();
+      my_allocs[k == 0 ? 0 : 1] += num_heap_allocs - allocs_start;
+   }
 
 #ifdef USE_MPI_WTIME
    my_rt = MPI_Wtime() - my_rt_start;
@@ -694,6 +1201,8 @@ int main(int argc, char *argv[])
    my_rt = tic_toc.RealTime();
 #endif
    delete amg;
+   long max_allocs[2];
+   MPI_Reduce(my_allocs, max_allocs, 2, MPI_LONG, MPI_MAX, 0, pmesh->GetComm());
 
    MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, pmesh->GetComm());
    MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
@@ -704,19 +1213,53 @@ int main(int argc, char *argv[])
       cout << "Total CG time:    " << rt_max << " (" << rt_min << ") sec."
            << endl;
       cout << "Time per CG step: "
-           << rt_max / pcg->GetNumIterations() << " ("
-           << rt_min / pcg->GetNumIterations() << ") sec." << endl;
+           << rt_max / cg_iters << " ("
+           << rt_min / cg_iters << ") sec." << endl;
       cout << "\n\"DOFs/sec\" in CG: "
-           << 1e-6*size*pcg->GetNumIterations()/rt_max << " ("
-           << 1e-6*size*pcg->GetNumIterations()/rt_min << ") million.\n"
+           << 1e-6*size*cg_iters/rt_max << " ("
+           << 1e-6*size*cg_iters/rt_min << ") million.\n"
            << endl;
+      // Per core rate, to compare runs with different numbers of threads per
+      // rank on the same node, e.g. with the flat MPI run
+      const int num_cores = num_procs*num_threads;
+      cout << "\"DOFs/sec\" in CG per core: "
+           << 1e-6*size*cg_iters/rt_max/num_cores << " ("
+           << 1e-6*size*cg_iters/rt_min/num_cores << ") million, "
+           << num_cores << " cores.\n" << endl;
+      if (num_solves > 1)
+      {
+         cout << "Number of solves: " << num_solves << " (the times above "
+              << "are totals)" << endl;
+         cout << "Heap allocations in the first solve: " << max_allocs[0]
+              << ", in the later solves: " << max_allocs[1]
+              << " (max over ranks)\n" << endl;
+      }
+      else
+      {
+         cout << "Heap allocations in the solve: " << max_allocs[0]
+              << " (max over ranks)\n" << endl;
+      }
+      // MFEM's CGSolver makes 12 (13 with a preconditioner) full-length vector
+      // reads and writes per step, outside of the operator and AMG.
+      const int cg_traffic = (pc_choice == NONE) ? 12 : 13;
+      cout << "Global reductions per CG step: "
+           << (srcg ? 1 : 2) << "\n";
+      cout << "Vector memory traffic per CG step: "
+           << 8*(fcg ? fcg->GetVectorTraffic() :
+                 srcg ? srcg->GetVectorTraffic() : cg_traffic)
+           << " bytes/dof (MFEM CGSolver: " << 8*cg_traffic
+           << " bytes/dof)\n" << endl;
    }
 
    // 15. Recover the parallel grid function corresponding to X. This is the
    //     local finite element solution on each processor.
-   if (perf && matrix_free)
+   if (aosoa)
+   {
+      fespace->GetProlongationMatrix()->Mult(X, x);
+   }
+   else if (perf && matrix_free)
    {
-      a_hpc->RecoverFEMSolution(X, *b, x);
+      a_hpc->GetOperator().RecoverFEMSolution(X, *b, x);
    }
    else
    {
@@ -755,6 +1298,7 @@ int main(int argc, char *argv[])
    delete a;
    delete a_hpc;
    if (a_oper != &A) { delete a_oper; }
+   delete P_aosoa;
    delete a_pc;
    delete b;
    delete fespace;
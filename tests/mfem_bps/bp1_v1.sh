@@ -20,6 +20,7 @@ function build_tests()
 {
    local num_tests="${#sol_p_list[@]}"
    local test_id= sol_p_lst= ir_order_lst= exe_sfx_lst=" " exe_lst=
+   local tuned_sfx_lst=" " ord_sfx_lst=
    for test_id; do
       local sft= need_to_build=0
       for ((sft = mesh_s_reduction_base;
@@ -28,25 +29,59 @@ function build_tests()
          set_test_params $test_id && { need_to_build=1; break; }
       done
       (( need_to_build == 0 )) && continue
-      # check if suffix is already in the list
-      if [[ -n "${exe_sfx_lst##* $suffix *}" ]]; then
+      # tests with autotuned parameters are built one at a time
+      if [[ -n "$autotune_applied" ]]; then
+         if [[ -n "${tuned_sfx_lst##* $suffix *}" ]]; then
+            tuned_sfx_lst+="$suffix "
+            make_test_exes "$sol_p" "$ir_order" "$suffix" \
+               "${test_name}$suffix" || return 1
+         fi
+         continue
+      fi
+      # with multi_order=yes, all orders with the same suffix are built into
+      # one executable; the makefile gets the suffix of each order
+      if [[ "$multi_order" == "yes" ]]; then
          sol_p_lst+=" $sol_p"
          ir_order_lst+=" $ir_order"
+         ord_sfx_lst+=" $suffix"
+      fi
+      # check if suffix is already in the list
+      if [[ -n "${exe_sfx_lst##* $suffix *}" ]]; then
+         if [[ "$multi_order" != "yes" ]]; then
+            sol_p_lst+=" $sol_p"
+            ir_order_lst+=" $ir_order"
+         fi
          exe_sfx_lst+="$suffix "
          exe_lst+=" ${test_name}$suffix"
       fi
    done
    exe_sfx_lst="${exe_sfx_lst% }"
    [[ -n "$sol_p_lst" ]] || return 0
+   ir_type="$default_ir_type"
+   vec_layout="$default_vec_layout"
+   batch_size="$default_batch_size"
+   test_cflags=""
+   [[ "$multi_order" == "yes" ]] && exe_sfx_lst=" ${ord_sfx_lst:1}"
+   make_test_exes "${sol_p_lst:1}" "${ir_order_lst:1}" "${exe_sfx_lst:1}" \
+      "${exe_lst:1}"
+}
+
+
+function make_test_exes()
+{
+   # Usage: make_test_exes "sol_p list" "ir_order list" "suffix list" "exes"
+   # Uses the current values of the build parameters (ir_type, vec_layout,
+   # batch_size, test_cflags, etc.)
+   local sol_p_lst="$1" ir_order_lst="$2" exe_sfx_lst="$3" exe_lst="$4"
    case "$rebuild_tests" in
       yes|Yes|YES)
          $dry_run cd "$test_exe_dir"
          $dry_run make -f "$test_dir/makefile" clean
-         $dry_run rm -f ${exe_lst:1}
+         $dry_run rm -f ${exe_lst}
          $dry_run cd "$test_dir"
          ;;
    esac
-   local make_extra=("geom=$geom" "mesh_p=$mesh_p" "sol_p=${sol_p_lst:1}")
+   local make_extra=("geom=$geom" "mesh_p=$mesh_p" "sol_p=${sol_p_lst}")
    make_extra=("${make_extra[@]}" "problem=$problem")
    if (( ir_type != 0 )); then
       make_extra=("${make_extra[@]}" "ir_type=$ir_type")
@@ -55,14 +90,29 @@ function build_tests()
       make_extra=("${make_extra[@]}" "vdim=$vdim")
       if [[ "$vec_layout" = "Ordering::byNODES" ]]; then
          make_extra=("${make_extra[@]}" "vec_layout=Ordering::byNODES")
+      elif [[ "$vec_layout" = "AoSoA" ]]; then
+         make_extra=("${make_extra[@]}" "vec_layout=AoSoA")
+         if [[ -n "$aosoa_block" ]]; then
+            make_extra=("${make_extra[@]}" "aosoa_block=$aosoa_block")
+         fi
       else
          make_extra=("${make_extra[@]}" "vec_layout=Ordering::byVDIM")
       fi
    fi
+   if [[ -n "$batch_size" ]]; then
+      make_extra=("${make_extra[@]}" "batch_size=$batch_size")
+   fi
    make_extra=("${make_extra[@]}" "use_mpi_wtime=$use_mpi_wtime")
-   make_extra=("${make_extra[@]}" "ir_order=${ir_order_lst:1}")
-   make_extra=("${make_extra[@]}" "exe_suffix=${exe_sfx_lst:1}")
-   make_extra=("${make_extra[@]}" "EXTRA_CXXFLAGS=$TEST_EXTRA_CFLAGS")
+   if [[ "$multi_order" == "yes" ]]; then
+      make_extra=("${make_extra[@]}" "multi_order=1")
+   fi
+   make_extra=("${make_extra[@]}" "ir_order=${ir_order_lst}")
+   make_extra=("${make_extra[@]}" "exe_suffix=${exe_sfx_lst}")
+   local extra_cxxflags="${test_cflags:-$TEST_EXTRA_CFLAGS}"
+   if [[ "$openmp" == "yes" ]]; then
+      extra_cxxflags+=" ${OPENMP_CFLAG:--fopenmp}"
+   fi
+   make_extra=("${make_extra[@]}" "EXTRA_CXXFLAGS=$extra_cxxflags")
    make_extra=("${make_extra[@]}" "MFEM_DIR=$MFEM_DIR")
    make_extra=("${make_extra[@]}" "BLD=$test_exe_dir/")
    make_extra=("${make_extra[@]}" "EXTRA_INCFLAGS=-I$MFEM_SOURCE_DIR")
@@ -108,6 +158,8 @@ function run_test()
    set_mpi_options
    local test_name_sfx="${test_name}${suffix}"
    local common_args="-no-vis $mesh_opt -rs $ser_ref -rp $par_ref -pc none"
+   common_args+=" -o $sol_p -irt $ir_type"
+   [[ "$openmp" == "yes" ]] && common_args+=" -omp"
    local num_args="${#args_list[@]}" args= all_args=()
    for ((i = 0; i < num_args; i++)) do
       args="${args_list[$i]}"
@@ -163,6 +215,21 @@ echo "max_approx_dofs: $max_approx_dofs"
 base_nxyz=(${base_nxyz[@]:-1 1 1})
 base_n=$(( base_nxyz[0]*base_nxyz[1]*base_nxyz[2] ))
 use_mpi_wtime=yes # leave empty for 'no'
+# build all orders into a single executable, selected at run time
+multi_order=${multi_order:-no}
+# element batch size of the templated operator (empty: MFEM's default)
+batch_size=${batch_size:-}
+# use the per-machine autotuned batch size and flags (yes/no, see autotune.sh)
+autotune=${autotune:-no}
+# thread the element loop inside each MPI rank (yes/no); the number of threads
+# is set with the '--threads' option of go.sh
+openmp=${openmp:-no}
+# operator representation: mf - matrix-free, asm - assembled CSR, auto - time
+# both and use the faster one for each order
+operator=${operator:-mf}
+default_ir_type="$ir_type"
+default_vec_layout="$vec_layout"
+default_batch_size="$batch_size"
 rebuild_tests=no
 
 local n=$(( num_proc_run/base_n ))
@@ -183,11 +250,50 @@ return 0
 
 }
 
+function autotune_prefix()
+{
+   # Print the autotune cache prefix for (problem, vdim, order $1, ir_type,
+   # vec_layout): the quadrature and the layout define the benchmark, so they
+   # are part of the key and are never taken from the cache.
+   local layout=s
+   if (( vdim > 1 )); then
+      case "$vec_layout" in
+         Ordering::byNODES) layout=n ;;
+         AoSoA) layout=a${aosoa_block} ;;
+         *) layout=v ;;
+      esac
+   fi
+   echo "autotune_p${problem}_v${vdim}_o${1}_q${ir_type}_l${layout}_"
+}
+
+function apply_autotune()
+{
+   # Set the tuning parameters (batch_size, test_cflags) for the current
+   # (problem, vdim, sol_p, ir_type, vec_layout) from the per-machine autotune
+   # cache (see autotune.sh) sourced by go.sh, if it has an entry; otherwise
+   # use the defaults from configure_tests. Enabled with autotune=yes, and
+   # disabled with multi_order=yes.
+   local pfx= entry=
+   ir_type="$default_ir_type"
+   vec_layout="$default_vec_layout"
+   batch_size="$default_batch_size"
+   test_cflags=""
+   autotune_applied=""
+   [[ "$autotune" == "yes" && "$multi_order" != "yes" ]] || return 0
+   pfx="$(autotune_prefix $sol_p)"
+   eval "entry=\"\${${pfx}VAR_LIST[*]}\""
+   [[ -n "$entry" ]] || return 0
+   eval "batch_size=\"\$${pfx}batch_size\""
+   eval "test_cflags=\"\$${pfx}cflags\""
+   autotune_applied=yes
+}
+
 function set_test_params()
 {
    [[ -n "$1" ]] && {
       sol_p="${sol_p_list[$1]}"
       ir_order="${ir_order_list[$1]}"
+      apply_autotune
       local max_elems=$(( max_approx_dofs/((sol_p**3)*vdim) ))
       mesh_s="0"
       while (( base_n*(2**(mesh_s+1)) <= max_elems )); do
@@ -227,14 +333,24 @@ function set_test_params()
          return 1
       fi
    fi
-   suffix=_${geom#Geometry::}_p${sol_p}_m${mesh_p}
-   (( ir_order != 0 )) && suffix+="_i${ir_order}"
+   if [[ "$multi_order" == "yes" ]]; then
+      suffix=_${geom#Geometry::}_m${mesh_p}
+   else
+      suffix=_${geom#Geometry::}_p${sol_p}_m${mesh_p}
+      (( ir_order != 0 )) && suffix+="_i${ir_order}"
+   fi
    (( ir_type != 0 )) && suffix+="_GLL"
+   [[ -n "$batch_size" ]] && suffix+="_b${batch_size}"
+   [[ -n "$autotune_applied" ]] && suffix+="_tuned"
+   [[ "$openmp" == "yes" ]] && suffix+="_omp"
+   suffix+="${suffix_extra}"
    (( problem != 0 )) && suffix="_Mass$suffix"
    (( vdim != 1 )) && {
-      [[ "$vec_layout" = "Ordering::byNODES" ]] && \
-         suffix="_VN$suffix" || \
-         suffix="_VV$suffix"
+      case "$vec_layout" in
+         Ordering::byNODES) suffix="_VN$suffix" ;;
+         AoSoA) suffix="_VA${aosoa_block}$suffix" ;;
+         *) suffix="_VV$suffix" ;;
+      esac
    }
    split3_power2 mesh_nxyz $mesh_s "${base_nxyz[@]}"
    make_mesh_file
@@ -274,7 +390,7 @@ echo
 [[ -n "$build_only" ]] && return
 
 $dry_run cd "$test_exe_dir"
-args_list=('-perf -mf')
+args_list=("-perf -$operator -solver ${solver:-cg}")
 total_memory_required_list=(8)  # guess-timates
 run_tests_if_enabled 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16
 
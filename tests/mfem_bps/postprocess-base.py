@@ -96,6 +96,10 @@ while True:
       elif '"DOFs/sec" in assembly' in line:
          # out.write(lnfmt%i+': %s'%line)
          data['assembly-dps']=1e6*float(line.split(' ')[3])
+      elif '"DOFs/sec" in CG per core' in line:
+         data['cg-iteration-dps-per-core']=1e6*float(line.split(' ')[5])
+      elif 'Threads per MPI rank:' in line:
+         data['num-threads']=int(line.split(':',1)[1].split(',',1)[0])
       elif '"DOFs/sec" in CG' in line:
          # out.write(lnfmt%i+': %s'%line)
          data['cg-iteration-dps']=1e6*float(line.split(' ')[3])
@@ -34,10 +34,27 @@
 //==============================================================================
 
 #include "mfem-performance.hpp"
+#include "cg-solvers.hpp"
+#include "element-subset.hpp"
+#include "heap-counter.hpp"
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <vector>
 #include <list>
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace mfem;
@@ -54,19 +71,39 @@ using namespace mfem;
 #define MESH_P 1
 #endif
 
+// Number of right-hand sides batched in the operator apply of --num-rhs, for
+// BP1 and BP3; the right-hand sides are the components of an NRHS-component
+// space, so that the geometric data is reused for all of them.
+#ifndef NRHS
+#define NRHS 4
+#endif
+
+// Solution and integration rule orders compiled into the executable, as a list
+// of BP_INSTANCE(sol_p, ir_order) entries; the instance is selected at run time
+// with --order and --ir-order. By default, only the instance for SOL_P
+// (default: 3) and IR_ORDER is built. BP_INSTANCE_LIST, e.g. set by the
+// makefile with multi_order=1, gives the list explicitly, and MULTI_ORDER
+// selects the grid of orders used in bp.sh.
+#if defined(BP_INSTANCE_LIST)
+#define BP_INSTANCES BP_INSTANCE_LIST
+#elif defined(MULTI_ORDER)
+#define BP_INSTANCES \
+   BP_INSTANCE(1,3) BP_INSTANCE(1,5) BP_INSTANCE(2,5) BP_INSTANCE(2,7) \
+   BP_INSTANCE(3,9) BP_INSTANCE(4,11) BP_INSTANCE(5,13) BP_INSTANCE(6,15) \
+   BP_INSTANCE(7,17) BP_INSTANCE(8,19)
+#else
 #ifndef SOL_P
 #define SOL_P 3
 #endif
-
 #ifndef IR_ORDER
 #define IR_ORDER 2*SOL_P+3
 #endif
+#define BP_INSTANCES BP_INSTANCE(SOL_P,IR_ORDER)
+#endif
 
 // Define template parameters for optimized build.
 const Geometry::Type geom     = GEOM;
 const int            mesh_p   = MESH_P;
-const int            sol_p    = SOL_P;
-const int            ir_order = IR_ORDER;
 const int            dim      = Geometry::Constants<geom>::Dimension;
 const bool           vec      = PROBLEM == 2 || PROBLEM == 4;
 
@@ -76,31 +113,59 @@ typedef H1_FiniteElementSpace<mesh_fe_t>      mesh_fes_t;
 typedef VectorLayout<Ordering::byNODES,dim>   mesh_layout_t;
 typedef VectorLayout<Ordering::byNODES,1>     scal_layout_t;
 typedef VectorLayout<Ordering::byVDIM,dim>    vec_layout_t;
+typedef VectorLayout<Ordering::byVDIM,NRHS>   rhs_layout_t;
+typedef VectorLayout<Ordering::byVDIM,
+                     2*(vec ? dim : 1)>       err_layout_t;
 typedef TMesh<mesh_fes_t,mesh_layout_t>       mesh_t;
 
-// Static solution finite element space type
-typedef H1_FiniteElement<geom,sol_p>          sol_fe_t;
-typedef H1_FiniteElementSpace<sol_fe_t>       sol_fes_t;
-
-// Static quadrature, coefficient and integrator types
-typedef TIntegrationRule<geom,ir_order>       int_rule_t;
+// Static coefficient and integrator types
 typedef TConstantCoefficient<>                coeff_t;
 typedef TIntegrator<coeff_t,TMassKernel>      mass_integ_t;
 typedef TIntegrator<coeff_t,TDiffusionKernel> diffusion_integ_t;
 
-// Static bilinear form type, combining the above types
+// Single precision versions of the coefficient and integrator types, used for
+// the inner solves of the mixed-precision iterative refinement. Only the
+// quadrature data and the element kernels are in single precision: the operator
+// is applied to the same double precision vectors as the outer loop, so the
+// vector memory traffic of the inner solves is not reduced.
+typedef TConstantCoefficient<float>            coeff_f_t;
+typedef TIntegrator<coeff_f_t,TMassKernel>     mass_integ_f_t;
+typedef TIntegrator<coeff_f_t,TDiffusionKernel> diffusion_integ_f_t;
+
+// Static solution finite element space, quadrature and bilinear form types for
+// solution order SOL_ORDER and integration rule order IR_ORD
+template <int SOL_ORDER, int IR_ORD>
+struct BPTypes
+{
+   typedef H1_FiniteElement<geom,SOL_ORDER>       sol_fe_t;
+   typedef H1_FiniteElementSpace<sol_fe_t>        sol_fes_t;
+   typedef TIntegrationRule<geom,IR_ORD>          int_rule_t;
+   typedef TIntegrationRule<geom,IR_ORD,float>    int_rule_f_t;
+
+   // Bilinear form types, combining the above types. HPCBilinearFormK applies
+   // the scalar operator to NRHS interleaved right-hand sides.
 #if PROBLEM == 1
-typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,mass_integ_t,scal_layout_t> HPCBilinearForm;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,mass_integ_t,scal_layout_t> HPCBilinearForm;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_f_t,mass_integ_f_t,scal_layout_t,float,float> HPCBilinearFormF;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,mass_integ_t,rhs_layout_t> HPCBilinearFormK;
 #elif PROBLEM == 2
-typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,mass_integ_t,vec_layout_t> HPCBilinearForm;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,mass_integ_t,vec_layout_t> HPCBilinearForm;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_f_t,mass_integ_f_t,vec_layout_t,float,float> HPCBilinearFormF;
 #elif PROBLEM == 3
-typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,diffusion_integ_t,scal_layout_t> HPCBilinearForm;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,diffusion_integ_t,scal_layout_t> HPCBilinearForm;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_f_t,diffusion_integ_f_t,scal_layout_t,float,float> HPCBilinearFormF;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,diffusion_integ_t,rhs_layout_t> HPCBilinearFormK;
 #elif PROBLEM == 4
-typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,diffusion_integ_t,vec_layout_t> HPCBilinearForm;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,diffusion_integ_t,vec_layout_t> HPCBilinearForm;
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_f_t,diffusion_integ_f_t,vec_layout_t,float,float> HPCBilinearFormF;
 #else
 #error "Invalid bake-off problem."
 #endif
 
+   // Mass form on the solution and error components, see ComputeL2Norms()
+   typedef TBilinearForm<mesh_t,sol_fes_t,int_rule_t,mass_integ_t,err_layout_t> HPCErrorForm;
+};
+
 // Naive factorization of number into roughly balanced factors
 vector<int> balanced_factorization(int number, int num_factors) {
 
@@ -166,162 +231,1179 @@ vector<int> balanced_factorization(int number, int num_factors) {
 
 }
 
-int main(int argc, char *argv[])
+// Placement of the vectors used in the solve:
+//  - MEM_DEFAULT: MFEM's allocation, first touched by the thread running setup;
+//  - MEM_FIRST_TOUCH: mmap'ed storage, first touched in parallel with the same
+//    static schedule as the threaded vector kernels, so that each page is placed
+//    on the NUMA node of the thread that computes on it;
+//  - MEM_THP: as MEM_FIRST_TOUCH, on 2 MiB aligned storage advised to use
+//    transparent huge pages;
+//  - MEM_HUGETLB: as MEM_FIRST_TOUCH, on explicit 2 MiB huge pages (from the
+//    hugetlbfs pool, see /proc/sys/vm/nr_hugepages), falling back to MEM_THP.
+enum MemoryMode { MEM_DEFAULT, MEM_FIRST_TOUCH, MEM_THP, MEM_HUGETLB };
+
+// Storage for placed vectors. Place(v) moves the data of v to new storage, which
+// v does not own; the storage is released when this object is destroyed.
+class VectorPlacement
 {
-   // Initialize MPI.
-   int num_procs, myid;
-   MPI_Init(&argc, &argv);
-   MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
-   MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+protected:
+   MemoryMode mode;
+   vector<pair<void *, size_t> > blocks;
+   int num_fallbacks;
 
-   // Initialize timers
-   double my_rt_start, my_rt, rt_min, rt_max;
+public:
+   static const size_t huge_page_size = 2*1024*1024;
 
-   // Parse command-line options.
-   int el_per_proc = 1;
-   double tol = 1e-6;
-   int max_iters = 500;
-   const char *pc = "none";
-   bool essential_bcs = true;
-   bool visualization = 1;
+   VectorPlacement(MemoryMode mode_) : mode(mode_), num_fallbacks(0)
+   {
+#ifndef __linux__
+      mode = MEM_DEFAULT;
+#endif
+   }
 
-   OptionsParser args(argc, argv);
-   args.AddOption(&el_per_proc, "-e", "--num-el-per-proc",
-                  "Number of elements per MPI rank.");
-   args.AddOption(&tol, "-tol", "--pcg-rel-tol",
-                  "Relative tolerance for PCG convergence.");
-   args.AddOption(&max_iters, "-i", "--max-iters",
-                  "Maximum number of PCG iterations.");
-   args.AddOption(&pc, "-pc", "--preconditioner",
-                  "Preconditioner: "
-                  "lor - low-order-refined (matrix-free) AMG, "
-                  "ho - high-order (assembled) AMG, "
-                  "jacobi, "
-                  "lumpedmass, "
-                  "none.");
-   args.AddOption(&essential_bcs, "-ess-bc", "--essential-bcs",
-                  "-nat-bc", "--natural-bcs",
-                  "Essential or natural boundary conditions.");
-   args.AddOption(&visualization, "-vis", "--visualization", "-no-vis",
-                  "--no-visualization",
-                  "Enable or disable GLVis visualization.");
-   args.Parse();
-   if (!args.Good())
+   MemoryMode GetMode() const { return mode; }
+
+   // Number of MEM_HUGETLB allocations that fell back to MEM_THP
+   int GetNumFallbacks() const { return num_fallbacks; }
+
+   void Place(Vector &v)
    {
-      if (myid == 0)
+      const int n = v.Size();
+      if (mode == MEM_DEFAULT || n == 0) { return; }
+#ifdef __linux__
+      const size_t bytes = ((n*sizeof(double) + huge_page_size - 1)/
+                            huge_page_size)*huge_page_size;
+      const int prot = PROT_READ | PROT_WRITE;
+      const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+      char *data = NULL;
+      if (mode == MEM_HUGETLB)
       {
-         args.PrintUsage(cout);
+         void *p = mmap(NULL, bytes, prot, flags | MAP_HUGETLB, -1, 0);
+         if (p != MAP_FAILED)
+         {
+            blocks.push_back(make_pair(p, bytes));
+            data = (char *)p;
+         }
+         else { num_fallbacks++; }
       }
-      MPI_Finalize();
-      return 1;
+      if (!data)
+      {
+         // Over-allocate to align the start to a huge page boundary
+         void *p = mmap(NULL, bytes + huge_page_size, prot, flags, -1, 0);
+         MFEM_VERIFY(p != MAP_FAILED, "mmap failed");
+         blocks.push_back(make_pair(p, bytes + huge_page_size));
+         const size_t offset = (size_t)p % huge_page_size;
+         data = (char *)p + (offset ? huge_page_size - offset : 0);
+         if (mode != MEM_FIRST_TOUCH) { madvise(data, bytes, MADV_HUGEPAGE); }
+      }
+      double *d = (double *)data;
+      const double *vd = v.GetData();
+      #pragma omp parallel for
+      for (int i = 0; i < n; i++) { d[i] = vd[i]; }
+      v.NewDataAndSize(d, n);
+#endif
+   }
+
+   ~VectorPlacement()
+   {
+#ifdef __linux__
+      for (size_t i = 0; i < blocks.size(); i++)
+      {
+         munmap(blocks[i].first, blocks[i].second);
+      }
+#endif
+   }
+};
+
+// Counter of the data TLB load misses of all OpenMP threads of this rank, using
+// one perf_event_open counter per thread. IsAvailable() is false when the
+// counters can not be opened, e.g. when not running on Linux or because of the
+// /proc/sys/kernel/perf_event_paranoid setting.
+class TLBMissCounter
+{
+protected:
+   vector<int> fds;
+   bool available;
+
+public:
+   TLBMissCounter() : available(false)
+   {
+#ifdef __linux__
+      int num_threads = 1;
+#ifdef _OPENMP
+      num_threads = omp_get_max_threads();
+#endif
+      fds.assign(num_threads, -1);
+      int num_open = 0;
+      #pragma omp parallel num_threads(num_threads) reduction(+:num_open)
+      {
+         int t = 0;
+#ifdef _OPENMP
+         t = omp_get_thread_num();
+#endif
+         struct perf_event_attr attr;
+         memset(&attr, 0, sizeof(attr));
+         attr.size = sizeof(attr);
+         attr.type = PERF_TYPE_HW_CACHE;
+         attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+         attr.disabled = 1;
+         attr.exclude_kernel = 1;
+         attr.exclude_hv = 1;
+         // Counts the calling thread only, on any CPU
+         fds[t] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+         if (fds[t] >= 0) { num_open++; }
+      }
+      available = (num_open == num_threads);
+#endif
+   }
+
+   bool IsAvailable() const { return available; }
+
+   void Start()
+   {
+#ifdef __linux__
+      for (size_t t = 0; t < fds.size() && available; t++)
+      {
+         ioctl(fds[t], PERF_EVENT_IOC_RESET, 0);
+         ioctl(fds[t], PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+   }
+
+   // Stop the counters and return the total count
+   long long Stop()
+   {
+      long long total = 0;
+#ifdef __linux__
+      for (size_t t = 0; t < fds.size() && available; t++)
+      {
+         long long count = 0;
+         ioctl(fds[t], PERF_EVENT_IOC_DISABLE, 0);
+         if (read(fds[t], &count, sizeof(count)) == sizeof(count))
+         {
+            total += count;
+         }
+      }
+#endif
+      return total;
+   }
+
+   ~TLBMissCounter()
+   {
+#ifdef __linux__
+      for (size_t t = 0; t < fds.size(); t++)
+      {
+         if (fds[t] >= 0) { close(fds[t]); }
+      }
+#endif
+   }
+};
+
+// Templated bilinear form of the benchmark problem on the space of an element
+// subset, see ElementSubsetOperator in element-subset.hpp
+template <typename form_t>
+form_t *CreateSubsetForm(const FiniteElementSpace &fes)
+{
+#if PROBLEM == 1 || PROBLEM == 2
+   return new form_t(mass_integ_t(coeff_t(1.0)), fes);
+#elif PROBLEM == 3 || PROBLEM == 4
+   return new form_t(diffusion_integ_t(coeff_t(1.0)), fes);
+#endif
+}
+
+// Parallel (true dof) operator with overlapped halo exchange. The local elements
+// are split into interior elements, which have no shared dofs, and boundary
+// elements. The shared-dof exchange (the action of the prolongation) is
+// started with a non-blocking broadcast, the interior elements are computed,
+// then the exchange is finished and the boundary elements are computed. The
+// time spent waiting for the exchange to finish is accumulated, so that it can
+// be compared with the time of a blocking exchange.
+template <typename form_t>
+class OverlapOperator : public Operator
+{
+protected:
+   ParFiniteElementSpace &pfes;
+   GroupCommunicator &gc;
+   Array<int> own_ldof, own_tdof;
+   ElementSubsetOperator<form_t> *interior, *boundary;
+   int num_interior, num_boundary;
+   mutable Vector x_l, y_l;
+   mutable double wait_time;
+   mutable int num_applies;
+
+public:
+   OverlapOperator(ParFiniteElementSpace &pfes_)
+      : Operator(pfes_.GetTrueVSize()), pfes(pfes_), gc(pfes_.GroupComm()),
+        wait_time(0.0), num_applies(0)
+   {
+      const int lsize = pfes.GetVSize();
+      for (int i = 0; i < lsize; i++)
+      {
+         const int tdof = pfes.GetLocalTDofNumber(i);
+         if (tdof >= 0)
+         {
+            own_ldof.Append(i);
+            own_tdof.Append(tdof);
+         }
+      }
+
+      // Mark the shared local dofs: the dofs in all groups except the local one
+      const Table &group_ldof = gc.GroupLDofTable();
+      Array<int> shared(lsize);
+      shared = 0;
+      for (int g = 1; g < group_ldof.Size(); g++)
+      {
+         const int *ldofs = group_ldof.GetRow(g);
+         for (int j = 0; j < group_ldof.RowSize(g); j++) { shared[ldofs[j]] = 1; }
+      }
+
+      Array<int> int_elems, bdr_elems, vdofs;
+      for (int e = 0; e < pfes.GetNE(); e++)
+      {
+         pfes.GetElementVDofs(e, vdofs);
+         bool is_shared = false;
+         for (int j = 0; j < vdofs.Size() && !is_shared; j++)
+         {
+            is_shared = shared[vdofs[j]];
+         }
+         (is_shared ? bdr_elems : int_elems).Append(e);
+      }
+      num_interior = int_elems.Size();
+      num_boundary = bdr_elems.Size();
+      interior = new ElementSubsetOperator<form_t>(pfes, int_elems,
+                                                   CreateSubsetForm<form_t>);
+      boundary = new ElementSubsetOperator<form_t>(pfes, bdr_elems,
+                                                   CreateSubsetForm<form_t>);
+      interior->Assemble();
+      boundary->Assemble();
+      x_l.SetSize(lsize);
+      y_l.SetSize(lsize);
+   }
+
+   virtual void Mult(const Vector &x, Vector &y) const
+   {
+      const int nown = own_ldof.Size();
+      for (int i = 0; i < nown; i++) { x_l(own_ldof[i]) = x(own_tdof[i]); }
+      gc.BcastBegin(x_l.GetData(), 0);
+
+      y_l = 0.0;
+      interior->AddMult(x_l, y_l);
+
+      const double wait_start = MPI_Wtime();
+      gc.BcastEnd(x_l.GetData(), 0);
+      wait_time += MPI_Wtime() - wait_start;
+
+      boundary->AddMult(x_l, y_l);
+
+      gc.ReduceBegin(y_l.GetData());
+      gc.ReduceEnd(y_l.GetData(), 0, GroupCommunicator::Sum);
+      for (int i = 0; i < nown; i++) { y(own_tdof[i]) = y_l(own_ldof[i]); }
+      num_applies++;
+   }
+
+   // Average time of a blocking shared-dof exchange, over 'reps' repetitions
+   double MeasureBlockingExchange(int reps) const
+   {
+      const double start = MPI_Wtime();
+      for (int r = 0; r < reps; r++)
+      {
+         gc.BcastBegin(x_l.GetData(), 0);
+         gc.BcastEnd(x_l.GetData(), 0);
+      }
+      return (MPI_Wtime() - start)/reps;
+   }
+
+   int GetNumInterior() const { return num_interior; }
+   int GetNumBoundary() const { return num_boundary; }
+   int GetNumApplies() const { return num_applies; }
+   double GetWaitTime() const { return wait_time; }
+
+   virtual ~OverlapOperator()
+   {
+      delete boundary;
+      delete interior;
+   }
+};
+
+// Parallel (true dof) operator with an OpenMP-threaded element loop, see
+// ThreadedElementOperator in element-subset.hpp. The gather of the owned dofs
+// and their scatter back are threaded as well.
+template <typename form_t>
+class ThreadedOperator : public Operator
+{
+protected:
+   ParFiniteElementSpace &pfes;
+   GroupCommunicator &gc;
+   Array<int> own_ldof, own_tdof;
+   ThreadedElementOperator<form_t> local;
+   mutable Vector x_l, y_l;
+
+public:
+   ThreadedOperator(ParFiniteElementSpace &pfes_)
+      : Operator(pfes_.GetTrueVSize()), pfes(pfes_), gc(pfes_.GroupComm()),
+        local(pfes_, CreateSubsetForm<form_t>)
+   {
+      const int lsize = pfes.GetVSize();
+      for (int i = 0; i < lsize; i++)
+      {
+         const int tdof = pfes.GetLocalTDofNumber(i);
+         if (tdof >= 0)
+         {
+            own_ldof.Append(i);
+            own_tdof.Append(tdof);
+         }
+      }
+      local.Assemble();
+      x_l.SetSize(lsize);
+      y_l.SetSize(lsize);
+   }
+
+   virtual void Mult(const Vector &x, Vector &y) const
+   {
+      const int nown = own_ldof.Size();
+      #pragma omp parallel for
+      for (int i = 0; i < nown; i++) { x_l(own_ldof[i]) = x(own_tdof[i]); }
+      gc.BcastBegin(x_l.GetData(), 0);
+      gc.BcastEnd(x_l.GetData(), 0);
+
+      local.Mult(x_l, y_l);
+
+      gc.ReduceBegin(y_l.GetData());
+      gc.ReduceEnd(y_l.GetData(), 0, GroupCommunicator::Sum);
+      #pragma omp parallel for
+      for (int i = 0; i < nown; i++) { y(own_tdof[i]) = y_l(own_ldof[i]); }
+   }
+
+   // Move the local work vectors to placed storage
+   void PlaceVectors(VectorPlacement &vp)
+   {
+      vp.Place(x_l);
+      vp.Place(y_l);
+   }
+
+   int GetNumThreads() const { return local.GetNumThreads(); }
+   int GetNumSharedDofs() const { return local.GetNumSharedDofs(); }
+};
+
+// Conjugate gradient solver for k right-hand sides stored interleaved, i.e. the
+// entry of dof j for right-hand side i is at index j*k + i (Ordering::byVDIM),
+// to be used with a batched operator on a k-component space. The k single-
+// reduction CG recurrences (see SingleReductionCGSolver) advance together: each
+// step makes one batched operator apply and one MPI_Allreduce of the 2k inner
+// products. A right-hand side that has converged is frozen, by setting its step
+// size to zero, until all have converged. No preconditioner is used.
+class MultiRHSCGSolver : public IterativeSolver
+{
+protected:
+   const int k;
+   mutable Vector r, w, p, s;
+   mutable vector<double> dots, gamma, alpha, beta, r0;
+   mutable vector<int> iters;
+
+   // Local parts of (r_i, r_i) and (w_i, r_i), i = 0..k-1, in one sweep
+   void LocalDots(const double *rd, const double *wd) const
+   {
+      const int n = width/k;
+      for (int i = 0; i < 2*k; i++) { dots[i] = 0.0; }
+      for (int j = 0; j < n; j++)
+      {
+         for (int i = 0; i < k; i++)
+         {
+            dots[2*i] += rd[j*k+i]*rd[j*k+i];
+            dots[2*i+1] += wd[j*k+i]*rd[j*k+i];
+         }
+      }
+   }
+
+public:
+   MultiRHSCGSolver(MPI_Comm comm_, int k_)
+      : IterativeSolver(comm_), k(k_), dots(2*k_), gamma(k_), alpha(k_),
+        beta(k_), r0(k_), iters(k_) { }
+
+   virtual void SetOperator(const Operator &op)
+   {
+      IterativeSolver::SetOperator(op);
+      MFEM_VERIFY(width % k == 0, "invalid operator size");
+      r.SetSize(width);
+      w.SetSize(width);
+      p.SetSize(width);
+      s.SetSize(width);
+   }
+
+   // Number of CG steps of right-hand side i in the last solve
+   int GetNumIterations(int i) const { return iters[i]; }
+
+   virtual void Mult(const Vector &b, Vector &x) const
+   {
+      const int n = width/k;
+      double *xd = x.GetData(), *rd = r.GetData(), *wd = w.GetData();
+      double *pd = p.GetData(), *sd = s.GetData();
+
+      r = b;
+      x = 0.0;
+      oper->Mult(r, w); // w = A r
+      LocalDots(rd, wd);
+      MPI_Allreduce(MPI_IN_PLACE, &dots[0], 2*k, MPI_DOUBLE, MPI_SUM, comm);
+
+      int num_active = 0;
+      double gamma_max = 0.0;
+      for (int i = 0; i < k; i++)
+      {
+         gamma[i] = dots[2*i];
+         r0[i] = std::max(gamma[i]*rel_tol*rel_tol, abs_tol*abs_tol);
+         iters[i] = 0;
+         alpha[i] = (gamma[i] > r0[i]) ? gamma[i]/dots[2*i+1] : 0.0;
+         if (alpha[i] != 0.0) { num_active++; }
+         gamma_max = std::max(gamma_max, gamma[i]);
+      }
+      if (print_level == 1 || print_level == 3)
+      {
+         cout << "   Iteration : " << setw(3) << 0 << "  max (r, r) = "
+              << gamma_max << (print_level == 3 ? " ...\n" : "\n");
+      }
+
+      converged = 0;
+      final_iter = 0;
+      for (int it = 1; num_active > 0; it++)
+      {
+         // p = r + beta p, s = w + beta s, x += alpha p, r -= alpha s, for all
+         // right-hand sides in one sweep
+         for (int j = 0; j < n; j++)
+         {
+            for (int i = 0; i < k; i++)
+            {
+               const int l = j*k + i;
+               const double pl = (it == 1) ? rd[l] : rd[l] + beta[i]*pd[l];
+               const double sl = (it == 1) ? wd[l] : wd[l] + beta[i]*sd[l];
+               pd[l] = pl;
+               sd[l] = sl;
+               xd[l] += alpha[i]*pl;
+               rd[l] -= alpha[i]*sl;
+            }
+         }
+         oper->Mult(r, w); // w = A r, batched
+         LocalDots(rd, wd);
+         MPI_Allreduce(MPI_IN_PLACE, &dots[0], 2*k, MPI_DOUBLE, MPI_SUM, comm);
+
+         gamma_max = 0.0;
+         for (int i = 0; i < k; i++)
+         {
+            if (alpha[i] == 0.0) { continue; }
+            if (dots[2*i] <= r0[i])
+            {
+               // Converged: freeze this right-hand side
+               gamma[i] = dots[2*i];
+               alpha[i] = beta[i] = 0.0;
+               iters[i] = it;
+               num_active--;
+               continue;
+            }
+            beta[i] = dots[2*i]/gamma[i];
+            const double delta = dots[2*i+1] - beta[i]*dots[2*i]/alpha[i];
+            alpha[i] = dots[2*i]/delta;
+            gamma[i] = dots[2*i];
+            gamma_max = std::max(gamma_max, gamma[i]);
+         }
+         if (print_level == 1)
+         {
+            cout << "   Iteration : " << setw(3) << it << "  max (r, r) = "
+                 << gamma_max << ", active: " << num_active << '\n';
+         }
+         final_iter = it;
+         if (num_active == 0) { converged = 1; break; }
+         if (it >= max_iter)
+         {
+            for (int i = 0; i < k; i++)
+            {
+               if (alpha[i] != 0.0) { iters[i] = it; }
+            }
+            break;
+         }
+      }
+      if (num_active == 0) { converged = 1; }
+      if (print_level >= 0 && !converged)
+      {
+         cout << "Multi-RHS PCG: No convergence!" << '\n';
+      }
+      if (print_level == 2 || print_level == 3)
+      {
+         cout << "Number of multi-RHS PCG iterations: " << final_iter << '\n';
+      }
+      double g = 0.0;
+      for (int i = 0; i < k; i++) { g = std::max(g, gamma[i]); }
+      final_norm = sqrt(g);
+   }
+};
+
+// The L2 norms of x0 and of x - x0, computed with a single matrix-free pass over
+// the local elements. The templated mass operator of type mass_form_t acts on a
+// space with 2*vdim components: those of x0 followed by those of x - x0. For a
+// local vector z and the local mass operator M, (z, M z) restricted to the
+// first or to the last vdim components is the square of the local part of the
+// first or of the second norm.
+template <typename mass_form_t>
+void ComputeL2Norms(ParFiniteElementSpace &fes, const Vector &x0,
+                    const Vector &x, double &norm_x0, double &norm_err)
+{
+   const int vd = fes.GetVDim(), nd = fes.GetNDofs();
+   FiniteElementSpace zfes(fes.GetMesh(), fes.FEColl(), 2*vd, Ordering::byVDIM);
+   mass_form_t m(mass_integ_t(coeff_t(1.0)), zfes);
+   Vector z(2*vd*nd), mz(2*vd*nd);
+   for (int j = 0; j < nd; j++)
+   {
+      for (int c = 0; c < vd; c++)
+      {
+         const int l = fes.DofToVDof(j, c);
+         z(j*2*vd + c) = x0(l);
+         z(j*2*vd + vd + c) = x(l) - x0(l);
+      }
+   }
+   m.Mult(z, mz); // not assembled: the geometry is evaluated on the fly
+   double loc[2] = { 0.0, 0.0 };
+   for (int j = 0; j < nd; j++)
+   {
+      for (int c = 0; c < 2*vd; c++)
+      {
+         loc[c < vd ? 0 : 1] += z(j*2*vd + c)*mz(j*2*vd + c);
+      }
+   }
+   MPI_Allreduce(MPI_IN_PLACE, loc, 2, MPI_DOUBLE, MPI_SUM, fes.GetComm());
+   norm_x0 = sqrt(loc[0]);
+   norm_err = sqrt(loc[1]);
+}
+
+// Templated bilinear form with access to its quadrature data, for checkpoints.
+// The data is an array of the form's p_assembled_t, with the size allocated by
+// TBilinearForm::Assemble().
+template <typename form_t>
+class CheckpointForm : public form_t
+{
+protected:
+   typedef typename form_t::p_assembled_t p_assembled_t;
+
+   int GetNumAssembled() const
+   {
+      const int NE = this->mesh.GetNE();
+      return ((NE + form_t::TE - 1)/form_t::TE)*form_t::BE;
+   }
+
+public:
+   template <typename integ_t>
+   CheckpointForm(const integ_t &integ, const FiniteElementSpace &fes)
+      : form_t(integ, fes) { }
+
+   long long GetAssembledDataSize() const
+   {
+      return (long long)sizeof(p_assembled_t)*GetNumAssembled();
+   }
+
+   // NULL if the form is not assembled
+   const char *GetAssembledData() const
+   {
+      return (const char *)this->assembled_data;
+   }
+
+   // Use the given data, e.g. read from a checkpoint, instead of Assemble()
+   void SetAssembledData(const char *data)
+   {
+      if (!this->assembled_data)
+      {
+         this->assembled_data = new p_assembled_t[GetNumAssembled()];
+      }
+      memcpy(this->assembled_data, data, GetAssembledDataSize());
+   }
+};
+
+// Parallel binary checkpoint, written and read with MPI-IO. The file contains a
+// header, a table with the sizes of the sections of each rank, and the sections
+// of all ranks, in rank order: the local part of the parallel mesh (in MFEM's
+// ParPrint format), the quadrature data of the operator, and the true-dof
+// solution vector. A checkpoint can be read only with the same number of ranks
+// and the same problem and orders.
+struct CheckpointHeader
+{
+   int magic, version, problem, sol_p, ir_order, num_procs;
+};
+const int checkpoint_magic = 0x4b435042; // "BPCK"
+const int checkpoint_version = 1;
+
+// Collective write (read) of 'size' bytes at 'offset'. The MPI-IO counts are
+// int, so larger sections are transferred in chunks; all ranks make the same
+// number of calls, with zero counts when their section is done. Returns false
+// on all ranks if the transfer failed on any rank.
+bool CheckpointIO(MPI_File fh, MPI_Comm comm, MPI_Offset offset, char *buf,
+                  long long size, bool write)
+{
+   const long long chunk = 1LL << 30;
+   long long num_chunks = (size + chunk - 1)/chunk;
+   MPI_Allreduce(MPI_IN_PLACE, &num_chunks, 1, MPI_LONG_LONG, MPI_MAX, comm);
+   int ok = 1;
+   MPI_Status status;
+   for (long long i = 0; i < num_chunks; i++)
+   {
+      const long long pos = std::min(i*chunk, size);
+      const int count = (int)std::min(chunk, size - pos);
+      const int err = write ?
+                      MPI_File_write_at_all(fh, offset + pos, buf + pos, count,
+                                            MPI_BYTE, &status) :
+                      MPI_File_read_at_all(fh, offset + pos, buf + pos, count,
+                                           MPI_BYTE, &status);
+      if (err != MPI_SUCCESS) { ok = 0; }
    }
+   MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+   return ok;
+}
+
+// Write a checkpoint; returns the total number of bytes written and the time
+bool WriteCheckpoint(const char *file_name, const CheckpointHeader &header,
+                     ParMesh &pmesh, const char *qdata, long long qdata_size,
+                     const Vector &X, long long &total_size, double &time)
+{
+   MPI_Comm comm = pmesh.GetComm();
+   int myid;
+   MPI_Comm_rank(comm, &myid);
+   const double start = MPI_Wtime();
+
+   ostringstream mesh_os;
+   mesh_os.precision(16);
+   pmesh.ParPrint(mesh_os);
+   const string mesh_str = mesh_os.str();
+   long long sizes[3] = { (long long)mesh_str.size(), qdata_size,
+                          (long long)(X.Size()*sizeof(double))
+                        };
+   long long my_size = sizes[0] + sizes[1] + sizes[2], offset = 0;
+   MPI_Exscan(&my_size, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+   if (myid == 0) { offset = 0; }
+   MPI_Allreduce(&my_size, &total_size, 1, MPI_LONG_LONG, MPI_SUM, comm);
+
+   MPI_File fh;
+   if (MPI_File_open(comm, (char *)file_name, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                     MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+   {
+      if (myid == 0) { cout << "Can not open " << file_name << endl; }
+      return false;
+   }
+   MPI_File_set_size(fh, 0);
+   const MPI_Offset table_start = sizeof(CheckpointHeader);
+   const MPI_Offset data_start =
+      table_start + header.num_procs*sizeof(sizes) + offset;
+   MPI_Status status;
    if (myid == 0)
    {
-      args.PrintOptions(cout);
+      MPI_File_write_at(fh, 0, (void *)&header, sizeof(header), MPI_BYTE,
+                        &status);
+   }
+   MPI_File_write_at_all(fh, table_start + myid*sizeof(sizes), sizes, 3,
+                         MPI_LONG_LONG, &status);
+   const bool ok =
+      CheckpointIO(fh, comm, data_start, (char *)mesh_str.data(), sizes[0],
+                   true) &&
+      CheckpointIO(fh, comm, data_start + sizes[0], (char *)qdata, sizes[1],
+                   true) &&
+      CheckpointIO(fh, comm, data_start + sizes[0] + sizes[1],
+                   (char *)X.GetData(), sizes[2], true);
+   MPI_File_close(&fh);
+   if (!ok)
+   {
+      if (myid == 0) { cout << "Error writing " << file_name << endl; }
+      return false;
    }
 
-   enum PCType { NONE, LOR, HO, JACOBI, LUMPEDMASS };
+   total_size += sizeof(header) + header.num_procs*sizeof(sizes);
+   time = MPI_Wtime() - start;
+   return true;
+}
+
+// Read a checkpoint written by WriteCheckpoint(); the header must match the
+// given one. Returns the total number of bytes read and the time.
+bool ReadCheckpoint(const char *file_name, MPI_Comm comm,
+                    const CheckpointHeader &expected, string &mesh_str,
+                    vector<char> &qdata, Vector &X, long long &total_size,
+                    double &time)
+{
+   int myid;
+   MPI_Comm_rank(comm, &myid);
+   const double start = MPI_Wtime();
+
+   MPI_File fh;
+   if (MPI_File_open(comm, (char *)file_name, MPI_MODE_RDONLY, MPI_INFO_NULL,
+                     &fh) != MPI_SUCCESS)
+   {
+      if (myid == 0) { cout << "Can not open " << file_name << endl; }
+      return false;
+   }
+   CheckpointHeader header;
+   MPI_Status status;
+   MPI_File_read_at_all(fh, 0, &header, sizeof(header), MPI_BYTE, &status);
+   if (header.magic != checkpoint_magic ||
+       header.version != checkpoint_version ||
+       header.problem != expected.problem || header.sol_p != expected.sol_p ||
+       header.ir_order != expected.ir_order ||
+       header.num_procs != expected.num_procs)
+   {
+      if (myid == 0)
+      {
+         cout << "The checkpoint " << file_name << " does not match the "
+              << "problem, the orders or the number of ranks." << endl;
+      }
+      MPI_File_close(&fh);
+      return false;
+   }
+
+   long long sizes[3];
+   const MPI_Offset table_start = sizeof(CheckpointHeader);
+   MPI_File_read_at_all(fh, table_start + myid*sizeof(sizes), sizes, 3,
+                        MPI_LONG_LONG, &status);
+   long long my_size = sizes[0] + sizes[1] + sizes[2], offset = 0;
+   MPI_Exscan(&my_size, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+   if (myid == 0) { offset = 0; }
+   MPI_Allreduce(&my_size, &total_size, 1, MPI_LONG_LONG, MPI_SUM, comm);
+   const MPI_Offset data_start =
+      table_start + header.num_procs*sizeof(sizes) + offset;
+
+   mesh_str.resize(sizes[0]);
+   qdata.resize(sizes[1]);
+   X.SetSize(sizes[2]/sizeof(double));
+   const bool ok =
+      CheckpointIO(fh, comm, data_start, &mesh_str[0], sizes[0], false) &&
+      CheckpointIO(fh, comm, data_start + sizes[0], qdata.data(), sizes[1],
+                   false) &&
+      CheckpointIO(fh, comm, data_start + sizes[0] + sizes[1],
+                   (char *)X.GetData(), sizes[2], false);
+   MPI_File_close(&fh);
+   if (!ok)
+   {
+      if (myid == 0) { cout << "Error reading " << file_name << endl; }
+      return false;
+   }
+
+   total_size += sizeof(header) + header.num_procs*sizeof(sizes);
+   time = MPI_Wtime() - start;
+   return true;
+}
+
+// Iterative refinement: the residual r = b - A x is computed with the (double
+// precision) operator A in an outer loop, and the corrections A d = r are
+// computed approximately with the given inner solver, e.g. a PCG solver using
+// a single precision operator. The inner solves start from d = 0, so the
+// iterative_mode of 'inner' is turned off. The work vectors r and d are given
+// by the caller, so that repeated solves do not allocate. Returns the number of
+// outer iterations; the total number of inner iterations is added to
+// 'inner_iters' and the time of the inner solves to 'inner_time'.
+int IterativeRefinement(const Operator &A, IterativeSolver &inner,
+                        const Vector &b, Vector &x, double rel_tol,
+                        int max_outer, MPI_Comm comm, bool print,
+                        Vector &r, Vector &d, int &inner_iters,
+                        double &inner_time)
+{
+   const double b_norm = sqrt(InnerProduct(comm, b, b));
+   inner.iterative_mode = false;
+   int k;
+   for (k = 0; k < max_outer; k++)
+   {
+      A.Mult(x, r);
+      subtract(b, r, r);
+      const double r_norm = sqrt(InnerProduct(comm, r, r));
+      if (print)
+      {
+         cout << "IR iteration : " << setw(3) << k << "  ||r|| / ||b|| = "
+              << r_norm / b_norm << endl;
+      }
+      if (r_norm <= rel_tol*b_norm) { break; }
+      const double inner_start = MPI_Wtime();
+      inner.Mult(r, d);
+      inner_time += MPI_Wtime() - inner_start;
+      inner_iters += inner.GetNumIterations();
+      x += d;
+   }
+   return k;
+}
+
+// Solver and preconditioner choices, and the options shared by all points of
+// a sweep. Note: the enumerator CG must be qualified as SolverType::CG, to
+// distinguish it from the mfem::CG function.
+enum PCType { NONE, LOR, HO, JACOBI, LUMPEDMASS };
+enum SolverType { CG, CG_FUSED, CG_SR, IR_MIXED };
+
+struct BPOptions
+{
+   double tol;
+   int max_iters;
    PCType pc_choice;
-   if (!strcmp(pc, "ho"))          { pc_choice = HO; }
-   else if (!strcmp(pc, "lor"))    { pc_choice = LOR; }
-   else if (!strcmp(pc, "jacobi")) { pc_choice = JACOBI; }
-   else if (!strcmp(pc, "lumpedmass")) { pc_choice = LUMPEDMASS; }
-   else if (!strcmp(pc, "none"))   { pc_choice = NONE; }
-   else
+   SolverType solver_choice;
+   double ir_inner_tol;
+   int ir_max_outer;
+   bool overlap;
+   bool threaded;
+   MemoryMode memory_mode;
+   bool tlb_misses;
+   int num_solves;
+   int num_rhs;
+   const char *checkpoint_file;
+   const char *restart_file;
+   bool essential_bcs;
+   bool visualization;
+};
+
+// Results of one run, reported in the sweep summary
+struct BPResult
+{
+   HYPRE_Int size;
+   int cg_iters;
+   double cg_time_min, cg_time_max;
+   double rel_error;
+};
+
+#if PROBLEM == 1 || PROBLEM == 3
+// Print the timing of a multi right-hand side solve; 'iters' is the total number
+// of CG iterations over the right-hand sides.
+void PrintMultiRHSTiming(const char *name, int k, HYPRE_Int size, int iters,
+                         int reductions, double rt_min, double rt_max)
+{
+   cout << name << ":\n"
+        << "   Total CG time:            " << rt_max << " (" << rt_min
+        << ") sec.\n"
+        << "   Time per right-hand side: " << rt_max/k << " (" << rt_min/k
+        << ") sec.\n"
+        << "   CG iterations (total):    " << iters << "\n"
+        << "   Global reductions:        " << reductions << "\n"
+        << "   \"DOFs/sec\" in CG (aggregate): " << 1e-6*size*iters/rt_max
+        << " (" << 1e-6*size*iters/rt_min << ") million.\n" << endl;
+}
+
+// Solve with k = opt.num_rhs (equal to NRHS) random right-hand sides, first all
+// together with MultiRHSCGSolver and the batched operator HPCBilinearFormK on a
+// k-component space, then one at a time with SingleReductionCGSolver and the
+// scalar operator, and compare the two. Returns 0 on success.
+template <int SOL_ORDER, int IR_ORD>
+int RunMultiRHS(ParMesh *pmesh, FiniteElementCollection *fec,
+                ParFiniteElementSpace *fespace, const Array<int> &ess_tdof_list,
+                const BPOptions &opt, BPResult &res)
+{
+   typedef BPTypes<SOL_ORDER,IR_ORD>              types;
+   typedef typename types::HPCBilinearForm        HPCBilinearForm;
+   typedef typename types::HPCBilinearFormK       HPCBilinearFormK;
+
+   MPI_Comm comm = pmesh->GetComm();
+   int myid;
+   MPI_Comm_rank(comm, &myid);
+   double my_rt_start, my_rt, rt_min, rt_max;
+   const int k = opt.num_rhs;
+
+   // Space with one component per right-hand side; its true dofs are
+   // interleaved, k per true dof of the scalar space.
+   ParFiniteElementSpace fespace_k(pmesh, fec, k, Ordering::byVDIM);
+   Array<int> ess_tdof_k;
+   if (pmesh->bdr_attributes.Size())
    {
-      mfem_error("Invalid preconditioner specified");
-      return 3;
+      Array<int> ess_bdr(pmesh->bdr_attributes.Max());
+      ess_bdr = opt.essential_bcs ? 1 : 0;
+      fespace_k.GetEssentialTrueDofs(ess_bdr, ess_tdof_k);
    }
+   const int n = fespace->GetTrueVSize();
+   const HYPRE_Int size = fespace->GlobalTrueVSize();
 
-   // Factorize number of processes and elements
-   vector<int> num_procs_dims = balanced_factorization(num_procs, dim);
-   int unrefined_el_per_proc = el_per_proc;
-   int refinement_levels = 0;
-   int refinement_factor = 1;
-   for (int d = 0; d < dim; ++d) { refinement_factor *= 2; }
-   while (unrefined_el_per_proc % refinement_factor == 0)
-   {
-      unrefined_el_per_proc /= refinement_factor;
-      refinement_levels++;
-   }
-   vector<int> unrefined_el_per_proc_dims
-     = balanced_factorization(unrefined_el_per_proc, dim);
-   reverse(unrefined_el_per_proc_dims.begin(),
-           unrefined_el_per_proc_dims.end());
-
-   // Generate serial mesh
-   Mesh *mesh;
-   switch (dim)
-   {
-   case 1:
-      mesh = new Mesh(num_procs * unrefined_el_per_proc, 1.0);
-      break;
-   case 2:
-      mesh = new Mesh(num_procs_dims[0] * unrefined_el_per_proc_dims[0],
-                      num_procs_dims[1] * unrefined_el_per_proc_dims[1],
-                      Element::QUADRILATERAL, 1, 1.0, 1.0);
-      break;
-   case 3:
-      mesh = new Mesh(num_procs_dims[0] * unrefined_el_per_proc_dims[0],
-                      num_procs_dims[1] * unrefined_el_per_proc_dims[1],
-                      num_procs_dims[2] * unrefined_el_per_proc_dims[2],
-                      Element::HEXAHEDRON, 1, 1.0, 1.0, 1.0);
-      break;
-   default:
-      mfem_error("Invalid number of dimensions");
-      return -1;
-   }
-
-   // Check if the generated mesh matches the optimized version
    if (myid == 0)
    {
-       cout << "High-performance version using integration rule with "
-            << int_rule_t::qpts << " points ..." << endl;
+      cout << "Assembling the scalar and the batched operators ..." << flush;
+   }
+#if PROBLEM == 1
+   HPCBilinearForm a(mass_integ_t(coeff_t(1.0)), *fespace);
+   HPCBilinearFormK a_k(mass_integ_t(coeff_t(1.0)), fespace_k);
+#else
+   HPCBilinearForm a(diffusion_integ_t(coeff_t(1.0)), *fespace);
+   HPCBilinearFormK a_k(diffusion_integ_t(coeff_t(1.0)), fespace_k);
+#endif
+   a.Assemble();
+   a_k.Assemble();
+   Operator *A = NULL, *A_k = NULL;
+   a.FormSystemOperator(ess_tdof_list, A);
+   a_k.FormSystemOperator(ess_tdof_k, A_k);
+   if (myid == 0)
+   {
+      cout << " done." << endl;
+   }
+
+   // Random exact solutions, zero on the essential boundary, and the
+   // corresponding right-hand sides
+   Vector X0(n*k), B(n*k), X(n*k);
+   X0.Randomize(0);
+   X0.SetSubVector(ess_tdof_k, 0.0);
+   A_k->Mult(X0, B);
+
+   // Batched solve
+   MultiRHSCGSolver mcg(comm, k);
+   mcg.SetRelTol(opt.tol);
+   mcg.SetMaxIter(opt.max_iters);
+   mcg.SetPrintLevel(3);
+   mcg.SetOperator(*A_k);
+#ifdef USE_MPI_WTIME
+   my_rt_start = MPI_Wtime();
+#else
+   tic_toc.Clear();
+   tic_toc.Start();
+#endif
+   mcg.Mult(B, X);
+#ifdef USE_MPI_WTIME
+   my_rt = MPI_Wtime() - my_rt_start;
+#else
+   tic_toc.Stop();
+   my_rt = tic_toc.RealTime();
+#endif
+   MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+   MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+   const double batch_rt_max = rt_max;
+   int batch_iters = 0;
+   for (int i = 0; i < k; i++) { batch_iters += mcg.GetNumIterations(i); }
+   res.size = size;
+   res.cg_iters = batch_iters;
+   res.cg_time_min = rt_min;
+   res.cg_time_max = rt_max;
+
+   // Errors of the batched solve, per right-hand side
+   vector<double> sums(2*k, 0.0);
+   for (int j = 0; j < n; j++)
+   {
+      for (int i = 0; i < k; i++)
+      {
+         const double e = X(j*k+i) - X0(j*k+i);
+         sums[2*i] += e*e;
+         sums[2*i+1] += X0(j*k+i)*X0(j*k+i);
+      }
    }
-   if (!mesh_t::MatchesGeometry(*mesh))
+   MPI_Allreduce(MPI_IN_PLACE, &sums[0], 2*k, MPI_DOUBLE, MPI_SUM, comm);
+   double batch_error = 0.0;
+   for (int i = 0; i < k; i++)
    {
-       if (myid == 0)
-       {
-           cout << "The given mesh does not match the optimized 'geom' parameter.\n"
-                << "Recompile with suitable 'geom' value." << endl;
-       }
-       delete mesh;
-       MPI_Finalize();
-       return 4;
+      batch_error = std::max(batch_error, sqrt(sums[2*i]/sums[2*i+1]));
    }
-   else if (!mesh_t::MatchesNodes(*mesh))
+   res.rel_error = batch_error;
+
+   if (myid == 0)
    {
-       if (myid == 0)
-       {
-           cout << "Switching the mesh curvature to match the "
-                << "optimized value (order " << mesh_p << ") ..." << endl;
-       }
-       mesh->SetCurvature(mesh_p, false, dim, Ordering::byNODES);
+      cout << "\nNumber of right-hand sides: " << k << "\n" << endl;
+      PrintMultiRHSTiming("Batched solve", k, size, batch_iters,
+                          mcg.GetNumIterations() + 1, rt_min, rt_max);
    }
 
-   // Define a parallel mesh by a partitioning of the serial mesh.
-   // Once the parallel mesh is defined, the serial mesh can be
-   // deleted.
+   // Separate solves, timing only the solver calls. Like the batched solve,
+   // each one starts from a zero initial guess.
+   SingleReductionCGSolver scg(comm);
+   scg.iterative_mode = false;
+   scg.SetRelTol(opt.tol);
+   scg.SetMaxIter(opt.max_iters);
+   scg.SetPrintLevel(0);
+   scg.SetOperator(*A);
+   Vector b1(n), x1(n);
+   int sep_iters = 0;
+   double sep_error = 0.0;
+   my_rt = 0.0;
+   for (int i = 0; i < k; i++)
+   {
+      for (int j = 0; j < n; j++) { b1(j) = B(j*k+i); }
+#ifdef USE_MPI_WTIME
+      my_rt_start = MPI_Wtime();
+#else
+      tic_toc.Clear();
+      tic_toc.Start();
+#endif
+      scg.Mult(b1, x1);
+#ifdef USE_MPI_WTIME
+      my_rt += MPI_Wtime() - my_rt_start;
+#else
+      tic_toc.Stop();
+      my_rt += tic_toc.RealTime();
+#endif
+      sep_iters += scg.GetNumIterations();
+      double loc[2] = { 0.0, 0.0 };
+      for (int j = 0; j < n; j++)
+      {
+         const double e = x1(j) - X0(j*k+i);
+         loc[0] += e*e;
+         loc[1] += X0(j*k+i)*X0(j*k+i);
+      }
+      MPI_Allreduce(MPI_IN_PLACE, loc, 2, MPI_DOUBLE, MPI_SUM, comm);
+      sep_error = std::max(sep_error, sqrt(loc[0]/loc[1]));
+   }
+   MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+   MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
    if (myid == 0)
    {
-      cout << "Initializing parallel mesh ..." << endl;
+      PrintMultiRHSTiming("Separate solves", k, size, sep_iters,
+                          sep_iters + k, rt_min, rt_max);
+      cout << "Speedup of the batched solve: " << rt_max/batch_rt_max << endl;
+      cout << "Relative error (max over right-hand sides): " << batch_error
+           << " (separate solves: " << sep_error << ")" << endl;
+   }
+
+   delete A_k;
+   delete A;
+   return 0;
+}
+#endif
+
+// Set up and solve the problem on the ranks of 'comm', with 'el_per_proc'
+// elements per rank, solution order SOL_ORDER and integration rule order
+// IR_ORD. All objects are freed before returning, so that the function can be
+// called repeatedly. Returns 0 on success.
+template <int SOL_ORDER, int IR_ORD>
+int RunBP(MPI_Comm comm, const BPOptions &opt, int el_per_proc, BPResult &res)
+{
+   typedef BPTypes<SOL_ORDER,IR_ORD>              types;
+   typedef typename types::sol_fes_t              sol_fes_t;
+   typedef typename types::int_rule_t             int_rule_t;
+   typedef typename types::HPCBilinearForm        HPCBilinearForm;
+   typedef typename types::HPCBilinearFormF       HPCBilinearFormF;
+   typedef typename types::HPCErrorForm           HPCErrorForm;
+   const int sol_p = SOL_ORDER;
+
+   int num_procs, myid;
+   MPI_Comm_size(comm, &num_procs);
+   MPI_Comm_rank(comm, &myid);
+
+   // Initialize timers
+   double my_rt_start, my_rt, rt_min, rt_max;
+
+   const double tol = opt.tol;
+   const int max_iters = opt.max_iters;
+   const PCType pc_choice = opt.pc_choice;
+   const SolverType solver_choice = opt.solver_choice;
+   const double ir_inner_tol = opt.ir_inner_tol;
+   const int ir_max_outer = opt.ir_max_outer;
+   const bool overlap = opt.overlap;
+   const bool threaded = opt.threaded;
+   const bool essential_bcs = opt.essential_bcs;
+   const bool visualization = opt.visualization;
+
+   // When restarting, the mesh, the quadrature data and the solution are read
+   // from the checkpoint, replacing the mesh generation and refinement, and the
+   // assembly of the operator.
+   const bool restart = opt.restart_file[0] != '\0';
+   CheckpointHeader ck_header = { checkpoint_magic, checkpoint_version, PROBLEM,
+                                  SOL_ORDER, IR_ORD, num_procs
+                                };
+   string ck_mesh;
+   vector<char> ck_qdata;
+   Vector ck_X;
+   ParMesh *pmesh = NULL;
+   if (restart)
+   {
+      if (myid == 0)
+      {
+         cout << "Reading the checkpoint " << opt.restart_file << " ..."
+              << flush;
+      }
+      long long ck_size;
+      double ck_time;
+      if (!ReadCheckpoint(opt.restart_file, comm, ck_header, ck_mesh, ck_qdata,
+                          ck_X, ck_size, ck_time))
+      {
+         return 7;
+      }
+      MPI_Reduce(&ck_time, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+      if (myid == 0)
+      {
+         cout << " done, " << rt_max << "s." << endl;
+         cout << "Checkpoint read: " << ck_size << " bytes, "
+              << 1e-9*ck_size/rt_max << " GB/s." << endl;
+      }
+      istringstream mesh_is(ck_mesh);
+      pmesh = new ParMesh(comm, mesh_is);
+      ck_mesh.clear();
    }
-   int *partitioning = mesh->CartesianPartitioning(num_procs_dims.data());
-   ParMesh *pmesh = new ParMesh(MPI_COMM_WORLD, *mesh, partitioning);
-   delete[] partitioning;
-   delete mesh;
-   for (int l = 0; l < refinement_levels; ++l)
+   else
    {
+      // Factorize number of processes and elements
+      vector<int> num_procs_dims = balanced_factorization(num_procs, dim);
+      int unrefined_el_per_proc = el_per_proc;
+      int refinement_levels = 0;
+      int refinement_factor = 1;
+      for (int d = 0; d < dim; ++d) { refinement_factor *= 2; }
+      while (unrefined_el_per_proc % refinement_factor == 0)
+      {
+         unrefined_el_per_proc /= refinement_factor;
+         refinement_levels++;
+      }
+      vector<int> unrefined_el_per_proc_dims
+        = balanced_factorization(unrefined_el_per_proc, dim);
+      reverse(unrefined_el_per_proc_dims.begin(),
+              unrefined_el_per_proc_dims.end());
+
+      // Generate serial mesh
+      Mesh *mesh;
+      switch (dim)
+      {
+      case 1:
+         mesh = new Mesh(num_procs * unrefined_el_per_proc, 1.0);
+         break;
+      case 2:
+         mesh = new Mesh(num_procs_dims[0] * unrefined_el_per_proc_dims[0],
+                         num_procs_dims[1] * unrefined_el_per_proc_dims[1],
+                         Element::QUADRILATERAL, 1, 1.0, 1.0);
+         break;
+      case 3:
+         mesh = new Mesh(num_procs_dims[0] * unrefined_el_per_proc_dims[0],
+                         num_procs_dims[1] * unrefined_el_per_proc_dims[1],
+                         num_procs_dims[2] * unrefined_el_per_proc_dims[2],
+                         Element::HEXAHEDRON, 1, 1.0, 1.0, 1.0);
+         break;
+      default:
+         mfem_error("Invalid number of dimensions");
+         return -1;
+      }
+
+      // Check if the generated mesh matches the optimized version
       if (myid == 0)
       {
-         cout << "Parallel refinement: level " << l << " -> level " << l+1
-              << " ..." << flush;
+          cout << "High-performance version using integration rule with "
+               << int_rule_t::qpts << " points ..." << endl;
+      }
+      if (!mesh_t::MatchesGeometry(*mesh))
+      {
+          if (myid == 0)
+          {
+              cout << "The given mesh does not match the optimized 'geom' parameter.\n"
+                   << "Recompile with suitable 'geom' value." << endl;
+          }
+          delete mesh;
+          return 4;
       }
-      pmesh->UniformRefinement();
-      MPI_Barrier(MPI_COMM_WORLD);
+      else if (!mesh_t::MatchesNodes(*mesh))
+      {
+          if (myid == 0)
+          {
+              cout << "Switching the mesh curvature to match the "
+                   << "optimized value (order " << mesh_p << ") ..." << endl;
+          }
+          mesh->SetCurvature(mesh_p, false, dim, Ordering::byNODES);
+      }
+
+      // Define a parallel mesh by a partitioning of the serial mesh.
+      // Once the parallel mesh is defined, the serial mesh can be
+      // deleted.
       if (myid == 0)
       {
-         cout << " done." << endl;
+         cout << "Initializing parallel mesh ..." << endl;
+      }
+      int *partitioning = mesh->CartesianPartitioning(num_procs_dims.data());
+      pmesh = new ParMesh(comm, *mesh, partitioning);
+      delete[] partitioning;
+      delete mesh;
+      for (int l = 0; l < refinement_levels; ++l)
+      {
+         if (myid == 0)
+         {
+            cout << "Parallel refinement: level " << l << " -> level " << l+1
+                 << " ..." << flush;
+         }
+         pmesh->UniformRefinement();
+         MPI_Barrier(comm);
+         if (myid == 0)
+         {
+            cout << " done." << endl;
+         }
       }
    }
    if (pmesh->MeshGenerator() & 1) // simplex mesh
@@ -344,21 +1426,9 @@ int main(int argc, char *argv[])
    {
       cout << "Number of finite element unknowns: " << size << endl;
    }
-   ParMesh *pmesh_lor = NULL;
-   FiniteElementCollection *fec_lor = NULL;
-   ParFiniteElementSpace *fespace_lor = NULL;
-   if (pc_choice == LOR)
-   {
-      pmesh_lor = new ParMesh(pmesh, sol_p, basis);
-      fec_lor = new H1_FECollection(1, dim);
-      fespace_lor
-        = new ParFiniteElementSpace(pmesh_lor,
-                                    fec_lor,
-                                    vec ? dim : 1,
-                                    vec ? Ordering::byVDIM : Ordering::byNODES);
-   }
 
-   // Check if the optimized version matches the given space
+   // Check if the optimized version matches the given space, before creating
+   // any other objects that would have to be freed on this error return
    if (!sol_fes_t::Matches(*fespace))
    {
       if (myid == 0)
@@ -369,10 +1439,23 @@ int main(int argc, char *argv[])
       delete fespace;
       delete fec;
       delete pmesh;
-      MPI_Finalize();
       return 5;
    }
 
+   ParMesh *pmesh_lor = NULL;
+   FiniteElementCollection *fec_lor = NULL;
+   ParFiniteElementSpace *fespace_lor = NULL;
+   if (pc_choice == LOR)
+   {
+      pmesh_lor = new ParMesh(pmesh, sol_p, basis);
+      fec_lor = new H1_FECollection(1, dim);
+      fespace_lor
+        = new ParFiniteElementSpace(pmesh_lor,
+                                    fec_lor,
+                                    vec ? dim : 1,
+                                    vec ? Ordering::byVDIM : Ordering::byNODES);
+   }
+
    // Determine the list of true (i.e. parallel conforming) essential
    // boundary dofs
    Array<int> ess_tdof_list;
@@ -383,6 +1466,21 @@ int main(int argc, char *argv[])
       fespace->GetEssentialTrueDofs(ess_bdr, ess_tdof_list);
    }
 
+#if PROBLEM == 1 || PROBLEM == 3
+   if (opt.num_rhs > 1)
+   {
+      const int ret = RunMultiRHS<SOL_ORDER,IR_ORD>(pmesh, fec, fespace,
+                                                    ess_tdof_list, opt, res);
+      delete fespace;
+      delete fespace_lor;
+      delete fec_lor;
+      delete pmesh_lor;
+      delete fec;
+      delete pmesh;
+      return ret;
+   }
+#endif
+
    // Define the solution vector x and RHS vector b
    // Note: subtract mean value if solving stiffness matrix problem
    ParGridFunction x0(fespace), x(fespace), b(fespace);
@@ -420,6 +1518,22 @@ int main(int argc, char *argv[])
 #endif
    x = x0;
 
+   // Check the solution read from the checkpoint
+   if (restart)
+   {
+      MFEM_VERIFY(ck_X.Size() == local_size,
+                  "invalid solution size in the checkpoint");
+      ParGridFunction x_ck(fespace);
+      x_ck.SetFromTrueDofs(ck_X);
+      double norm_x0, norm_err;
+      ComputeL2Norms<HPCErrorForm>(*fespace, x0, x_ck, norm_x0, norm_err);
+      if (myid == 0)
+      {
+         cout << "Relative error of the checkpoint solution: "
+              << norm_err / norm_x0 << endl;
+      }
+   }
+
    // Set up bilinear form for preconditioner
    ParBilinearForm *a_pc = NULL;
    if (pc_choice == LOR)
@@ -431,38 +1545,125 @@ int main(int argc, char *argv[])
       a_pc = new ParBilinearForm(fespace);
    }
 
-   // High-performance assembly/evaluation using the templated operator type
-   HPCBilinearForm *a = NULL;
-   if (myid == 0)
+   // High-performance assembly/evaluation using the templated operator type.
+   // With --overlap or --openmp, the element subset operators set up below
+   // replace it in the solve, so it is not assembled; it is then only used,
+   // unassembled, in the setup of the linear system and the preconditioner.
+   CheckpointForm<HPCBilinearForm> *a = NULL;
+   const bool subset_ops = overlap || threaded;
+   if (myid == 0 && !subset_ops)
+   {
+      cout << (restart ? "Loading" : "Assembling") << " the local matrix ..."
+           << flush;
+   }
+#ifdef USE_MPI_WTIME
+   my_rt_start = MPI_Wtime();
+#else
+   tic_toc.Clear();
+   tic_toc.Start();
+#endif
+#if PROBLEM == 1 || PROBLEM == 2
+   a = new CheckpointForm<HPCBilinearForm>(mass_integ_t(coeff_t(1.0)),
+                                           *fespace);
+#elif PROBLEM == 3 || PROBLEM == 4
+   a = new CheckpointForm<HPCBilinearForm>(diffusion_integ_t(coeff_t(1.0)),
+                                           *fespace);
+#endif
+   if (restart)
+   {
+      MFEM_VERIFY((long long)ck_qdata.size() == a->GetAssembledDataSize(),
+                  "invalid quadrature data size in the checkpoint");
+      a->SetAssembledData(ck_qdata.data());
+      vector<char>().swap(ck_qdata);
+   }
+   else if (!subset_ops)
+   {
+      a->Assemble();
+   }
+#ifdef USE_MPI_WTIME
+   my_rt = MPI_Wtime() - my_rt_start;
+#else
+   tic_toc.Stop();
+   my_rt = tic_toc.RealTime();
+#endif
+   MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, pmesh->GetComm());
+   MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+   if (myid == 0 && !subset_ops)
+   {
+      cout << " done, " << rt_max << " (" << rt_min << ") s." << endl;
+      cout << "\n\"DOFs/sec\" in local assembly: "
+           << 1e-6*size/rt_max << " ("
+           << 1e-6*size/rt_min << ") million.\n" << endl;
+   }
+
+   // Operator with overlapped halo exchange, used in place of a_oper
+   OverlapOperator<HPCBilinearForm> *ovl_oper = NULL;
+   Operator *ovl_sys_oper = NULL;
+   if (overlap)
    {
-      cout << "Assembling the local matrix ..." << flush;
+      if (myid == 0)
+      {
+         cout << "Setting up the overlapped operator ..." << flush;
+      }
+#ifdef USE_MPI_WTIME
+      my_rt_start = MPI_Wtime();
+#else
+      tic_toc.Clear();
+      tic_toc.Start();
+#endif
+      ovl_oper = new OverlapOperator<HPCBilinearForm>(*fespace);
+      ovl_sys_oper = new ConstrainedOperator(ovl_oper, ess_tdof_list);
+#ifdef USE_MPI_WTIME
+      my_rt = MPI_Wtime() - my_rt_start;
+#else
+      tic_toc.Stop();
+      my_rt = tic_toc.RealTime();
+#endif
+      MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+      long loc_el[2] = { ovl_oper->GetNumInterior(), ovl_oper->GetNumBoundary() };
+      long glob_el[2];
+      MPI_Reduce(loc_el, glob_el, 2, MPI_LONG, MPI_SUM, 0, pmesh->GetComm());
+      if (myid == 0)
+      {
+         cout << " done, " << rt_max << "s." << endl;
+         cout << "Interior elements: " << glob_el[0]
+              << ", boundary elements: " << glob_el[1] << endl;
+      }
    }
+
+   // Operator with an OpenMP-threaded element loop, used in place of a_oper
+   ThreadedOperator<HPCBilinearForm> *thr_oper = NULL;
+   Operator *thr_sys_oper = NULL;
+   if (threaded)
+   {
+      if (myid == 0)
+      {
+         cout << "Assembling the threaded operator ..." << flush;
+      }
 #ifdef USE_MPI_WTIME
-   my_rt_start = MPI_Wtime();
+      my_rt_start = MPI_Wtime();
 #else
-   tic_toc.Clear();
-   tic_toc.Start();
-#endif
-#if PROBLEM == 1 || PROBLEM == 2
-   a = new HPCBilinearForm(mass_integ_t(coeff_t(1.0)), *fespace);
-#elif PROBLEM == 3 || PROBLEM == 4
-   a = new HPCBilinearForm(diffusion_integ_t(coeff_t(1.0)), *fespace);
+      tic_toc.Clear();
+      tic_toc.Start();
 #endif
-   a->Assemble();
+      thr_oper = new ThreadedOperator<HPCBilinearForm>(*fespace);
+      thr_sys_oper = new ConstrainedOperator(thr_oper, ess_tdof_list);
 #ifdef USE_MPI_WTIME
-   my_rt = MPI_Wtime() - my_rt_start;
+      my_rt = MPI_Wtime() - my_rt_start;
 #else
-   tic_toc.Stop();
-   my_rt = tic_toc.RealTime();
+      tic_toc.Stop();
+      my_rt = tic_toc.RealTime();
 #endif
-   MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, pmesh->GetComm());
-   MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
-   if (myid == 0)
-   {
-      cout << " done, " << rt_max << " (" << rt_min << ") s." << endl;
-      cout << "\n\"DOFs/sec\" in local assembly: "
-           << 1e-6*size/rt_max << " ("
-           << 1e-6*size/rt_min << ") million.\n" << endl;
+      MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+      long loc_shared = thr_oper->GetNumSharedDofs(), glob_shared;
+      MPI_Reduce(&loc_shared, &glob_shared, 1, MPI_LONG, MPI_SUM, 0,
+                 pmesh->GetComm());
+      if (myid == 0)
+      {
+         cout << " done, " << rt_max << "s." << endl;
+         cout << "Threads per MPI rank: " << thr_oper->GetNumThreads()
+              << ", dofs on thread interfaces: " << glob_shared << endl;
+      }
    }
 
    // Apply operator matrix
@@ -476,7 +1677,20 @@ int main(int argc, char *argv[])
    tic_toc.Clear();
    tic_toc.Start();
 #endif
-   a->Mult(x, b);
+   if (subset_ops)
+   {
+      // b = A x, with the operator used in the solve: the true-dof result is
+      // placed in the owned local dofs, so that P^T b is the same
+      Vector X_0(local_size), B_0(local_size);
+      x.GetTrueDofs(X_0);
+      if (overlap) { ovl_oper->Mult(X_0, B_0); }
+      else { thr_oper->Mult(X_0, B_0); }
+      fespace->GetRestrictionMatrix()->MultTranspose(B_0, b);
+   }
+   else
+   {
+      a->Mult(x, b);
+   }
 #ifdef USE_MPI_WTIME
    my_rt = MPI_Wtime() - my_rt_start;
 #else
@@ -604,15 +1818,67 @@ int main(int argc, char *argv[])
       cout << " done, " << rt_max << "s." << endl;
    }
 
-   // Solve with CG or PCG, depending if the matrix A_pc is available
-   CGSolver *pcg;
-   pcg = new CGSolver(pmesh->GetComm());
-   pcg->SetRelTol(tol);
+   // Single precision operator for the inner solves of ir-mixed
+   HPCBilinearFormF *a_f = NULL;
+   Operator *a_f_oper = NULL;
+   if (solver_choice == IR_MIXED)
+   {
+      if (myid == 0)
+      {
+         cout << "Assembling the single precision operator ..." << flush;
+      }
+#ifdef USE_MPI_WTIME
+      my_rt_start = MPI_Wtime();
+#else
+      tic_toc.Clear();
+      tic_toc.Start();
+#endif
+#if PROBLEM == 1 || PROBLEM == 2
+      a_f = new HPCBilinearFormF(mass_integ_f_t(coeff_f_t(1.0f)), *fespace);
+#elif PROBLEM == 3 || PROBLEM == 4
+      a_f = new HPCBilinearFormF(diffusion_integ_f_t(coeff_f_t(1.0f)), *fespace);
+#endif
+      a_f->Assemble();
+      a_f->FormSystemOperator(ess_tdof_list, a_f_oper);
+#ifdef USE_MPI_WTIME
+      my_rt = MPI_Wtime() - my_rt_start;
+#else
+      tic_toc.Stop();
+      my_rt = tic_toc.RealTime();
+#endif
+      MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+      if (myid == 0)
+      {
+         cout << " done, " << rt_max << "s." << endl;
+      }
+   }
+
+   Operator *solve_oper = overlap ? ovl_sys_oper :
+                          threaded ? thr_sys_oper : a_oper;
+
+   // Solve with CG or PCG, depending if the matrix A_pc is available. With
+   // ir-mixed, this is the inner solver, using the single precision operator.
+   IterativeSolver *pcg;
+   FusedCGSolver *fcg = NULL;
+   SingleReductionCGSolver *srcg = NULL;
+   if (solver_choice == CG_FUSED || solver_choice == IR_MIXED)
+   {
+      pcg = fcg = new FusedCGSolver(pmesh->GetComm());
+   }
+   else if (solver_choice == CG_SR)
+   {
+      pcg = srcg = new SingleReductionCGSolver(pmesh->GetComm());
+   }
+   else
+   {
+      pcg = new CGSolver(pmesh->GetComm());
+   }
+   pcg->SetRelTol(solver_choice == IR_MIXED ? ir_inner_tol : tol);
    pcg->SetMaxIter(max_iters);
-   pcg->SetPrintLevel(1);
+   pcg->SetPrintLevel(solver_choice == IR_MIXED ? 3 : 1);
 
    HypreSolver* pc_oper = NULL;
-   pcg->SetOperator(*a_oper);
+   pcg->SetOperator(solver_choice == IR_MIXED ? *a_f_oper : *solve_oper);
    if (pc_choice == HO || pc_choice == LOR)
    {
       pc_oper = new HypreBoomerAMG(*A_pc);
@@ -620,10 +1886,65 @@ int main(int argc, char *argv[])
    }
    if (pc_choice == JACOBI || pc_choice == LUMPEDMASS)
    {
-      pc_oper = new HypreDiagScale(*A_pc);
-      pcg->SetPreconditioner(*pc_oper);
+      if (fcg || srcg)
+      {
+         // Apply the diagonal scaling inside the fused vector updates
+         Vector pc_diag;
+         A_pc->GetDiag(pc_diag);
+         if (fcg) { fcg->SetDiagonalPreconditioner(pc_diag); }
+         else { srcg->SetDiagonalPreconditioner(pc_diag); }
+      }
+      else
+      {
+         pc_oper = new HypreDiagScale(*A_pc);
+         pcg->SetPreconditioner(*pc_oper);
+      }
+   }
+
+   // Full-length vector reads and writes per CG step, outside of the operator
+   // and AMG: MFEM's CGSolver does 12 without a preconditioner, 13 with one,
+   // plus 3 for the HypreDiagScale apply.
+   int cg_traffic = (pc_choice == NONE) ? 12 : 13;
+   if (pc_choice == JACOBI || pc_choice == LUMPEDMASS) { cg_traffic += 3; }
+
+   // Move the vectors used in the solve to placed storage. The quadrature data
+   // is first touched by the computing threads with --openmp, where each chunk
+   // is assembled by the thread that applies it.
+   VectorPlacement placement(opt.memory_mode);
+   if (placement.GetMode() != MEM_DEFAULT)
+   {
+      placement.Place(X);
+      placement.Place(B);
+      if (fcg) { fcg->PlaceVectors(placement); }
+      if (srcg) { srcg->PlaceVectors(placement); }
+      if (thr_oper) { thr_oper->PlaceVectors(placement); }
+      int fallbacks = placement.GetNumFallbacks();
+      MPI_Allreduce(MPI_IN_PLACE, &fallbacks, 1, MPI_INT, MPI_SUM,
+                    pmesh->GetComm());
+      if (myid == 0 && fallbacks > 0)
+      {
+         cout << "Huge page pool exhausted: " << fallbacks << " vectors use "
+              << "transparent huge pages instead." << endl;
+      }
+   }
+   TLBMissCounter *tlb = opt.tlb_misses ? new TLBMissCounter : NULL;
+
+   // Work vectors of ir-mixed, allocated once for all solves
+   Vector ir_r, ir_d;
+   if (solver_choice == IR_MIXED)
+   {
+      ir_r.SetSize(B.Size());
+      ir_d.SetSize(B.Size());
+      placement.Place(ir_r);
+      placement.Place(ir_d);
    }
 
+   // Solve num_solves times with the same setup; the first solve includes any
+   // setup done lazily on first use, e.g. by hypre.
+   const int num_solves = opt.num_solves;
+   long my_allocs[2] = { 0, 0 }; // first solve, later solves
+   if (tlb) { tlb->Start(); }
+
 #ifdef USE_MPI_WTIME
    my_rt_start = MPI_Wtime();
 #else
@@ -631,7 +1952,26 @@ int main(int argc, char *argv[])
    tic_toc.Start();
 #endif
 
-   pcg->Mult(B, X);
+   int cg_iters = 0, ir_outer_iters = 0;
+   double my_ir_inner_rt = 0.0;
+   for (int k = 0; k < num_solves; k++)
+   {
+      const long allocs_start = num_heap_allocs;
+      if (k > 0) { X = 0.0; }
+      if (solver_choice == IR_MIXED)
+      {
+         ir_outer_iters += IterativeRefinement(*solve_oper, *pcg, B, X, tol,
+                                               ir_max_outer, pmesh->GetComm(),
+                                               myid == 0, ir_r, ir_d, cg_iters,
+                                               my_ir_inner_rt);
+      }
+      else
+      {
+         pcg->Mult(B, X);
+         cg_iters += pcg->GetNumIterations();
+      }
+      my_allocs[k == 0 ? 0 : 1] += num_heap_allocs - allocs_start;
+   }
 
 #ifdef USE_MPI_WTIME
    my_rt = MPI_Wtime() - my_rt_start;
@@ -639,25 +1979,131 @@ int main(int argc, char *argv[])
    tic_toc.Stop();
    my_rt = tic_toc.RealTime();
 #endif
+   const long long my_tlb_misses = tlb ? tlb->Stop() : 0;
    delete pc_oper;
+   long max_allocs[2];
+   MPI_Reduce(my_allocs, max_allocs, 2, MPI_LONG, MPI_MAX, 0, pmesh->GetComm());
 
    MPI_Reduce(&my_rt, &rt_min, 1, MPI_DOUBLE, MPI_MIN, 0, pmesh->GetComm());
    MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+   // With ir-mixed, the CG rates are those of the inner solves, without the
+   // outer (double precision) residual computations
+   double cg_rt_min = rt_min, cg_rt_max = rt_max;
+   if (solver_choice == IR_MIXED)
+   {
+      MPI_Reduce(&my_ir_inner_rt, &cg_rt_min, 1, MPI_DOUBLE, MPI_MIN, 0,
+                 pmesh->GetComm());
+      MPI_Reduce(&my_ir_inner_rt, &cg_rt_max, 1, MPI_DOUBLE, MPI_MAX, 0,
+                 pmesh->GetComm());
+   }
    if (myid == 0)
    {
       // Note: In the pcg algorithm, the number of operator Mult() calls is
       //       N_iter and the number of preconditioner Mult() calls is N_iter+1.
-      cout << "Total CG time:    " << rt_max << " (" << rt_min << ") sec."
-           << endl;
+      //       With ir-mixed, the CG steps are those of the inner solves.
+      if (solver_choice == IR_MIXED)
+      {
+         cout << "IR outer iterations: " << ir_outer_iters << endl;
+         cout << "IR inner PCG iterations: " << cg_iters << endl;
+         cout << "Total IR time:    " << rt_max << " (" << rt_min
+              << ") sec." << endl;
+         cout << "IR inner solve time: " << cg_rt_max << " (" << cg_rt_min
+              << ") sec." << endl;
+      }
+      else
+      {
+         cout << "Total CG time:    " << rt_max << " (" << rt_min << ") sec."
+              << endl;
+      }
       cout << "Time per CG step: "
-           << rt_max / pcg->GetNumIterations() << " ("
-           << rt_min / pcg->GetNumIterations() << ") sec." << endl;
+           << cg_rt_max / cg_iters << " ("
+           << cg_rt_min / cg_iters << ") sec." << endl;
       cout << "\n\"DOFs/sec\" in CG: "
-           << 1e-6*size*pcg->GetNumIterations()/rt_max << " ("
-           << 1e-6*size*pcg->GetNumIterations()/rt_min << ") million.\n"
+           << 1e-6*size*cg_iters/cg_rt_max << " ("
+           << 1e-6*size*cg_iters/cg_rt_min << ") million.\n"
            << endl;
+      // Per core rate, to compare runs with different numbers of threads per
+      // rank on the same node, e.g. with the flat MPI run
+      const int num_cores = num_procs*(thr_oper ? thr_oper->GetNumThreads() : 1);
+      cout << "\"DOFs/sec\" in CG per core: "
+           << 1e-6*size*cg_iters/cg_rt_max/num_cores << " ("
+           << 1e-6*size*cg_iters/cg_rt_min/num_cores << ") million, "
+           << num_cores << " cores.\n" << endl;
+      if (num_solves > 1)
+      {
+         cout << "Number of solves: " << num_solves << " (the times and "
+              << "iterations above are totals)" << endl;
+         cout << "Heap allocations in the first solve: " << max_allocs[0]
+              << ", in the later solves: " << max_allocs[1]
+              << " (max over ranks)\n" << endl;
+      }
+      else
+      {
+         cout << "Heap allocations in the solve: " << max_allocs[0]
+              << " (max over ranks)\n" << endl;
+      }
+      cout << "Global reductions per CG step: "
+           << (srcg ? 1 : 2) << "\n";
+      cout << "Vector memory traffic per CG step: "
+           << 8*(fcg ? fcg->GetVectorTraffic() :
+                 srcg ? srcg->GetVectorTraffic() : cg_traffic)
+           << " bytes/dof (MFEM CGSolver: " << 8*cg_traffic
+           << " bytes/dof)\n" << endl;
+   }
+
+   if (tlb)
+   {
+      int tlb_ok = tlb->IsAvailable(), all_ok;
+      long long tlb_misses;
+      MPI_Reduce(&tlb_ok, &all_ok, 1, MPI_INT, MPI_MIN, 0, pmesh->GetComm());
+      MPI_Reduce(&my_tlb_misses, &tlb_misses, 1, MPI_LONG_LONG, MPI_SUM, 0,
+                 pmesh->GetComm());
+      if (myid == 0)
+      {
+         if (all_ok)
+         {
+            cout << "dTLB load misses in CG: " << tlb_misses << " ("
+                 << double(tlb_misses)/cg_iters/size
+                 << " per CG step per DOF)\n" << endl;
+         }
+         else
+         {
+            cout << "dTLB load miss counters are not available.\n" << endl;
+         }
+      }
+      delete tlb;
+   }
+
+   // Compare the exposed exchange wait time per apply with the time of a
+   // blocking exchange; the difference is the hidden communication time.
+   if (ovl_oper && ovl_oper->GetNumApplies() > 0)
+   {
+      double my_wait = ovl_oper->GetWaitTime() / ovl_oper->GetNumApplies();
+      double my_exch = ovl_oper->MeasureBlockingExchange(10);
+      double my_hidden = std::max(my_exch - my_wait, 0.0);
+      double wait_max, exch_max, hidden_min, hidden_max;
+      MPI_Reduce(&my_wait, &wait_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+      MPI_Reduce(&my_exch, &exch_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+      MPI_Reduce(&my_hidden, &hidden_min, 1, MPI_DOUBLE, MPI_MIN, 0,
+                 pmesh->GetComm());
+      MPI_Reduce(&my_hidden, &hidden_max, 1, MPI_DOUBLE, MPI_MAX, 0,
+                 pmesh->GetComm());
+      if (myid == 0)
+      {
+         cout << "Blocking exchange time per apply: " << exch_max << " sec."
+              << endl;
+         cout << "Exposed exchange time per apply:  " << wait_max << " sec."
+              << endl;
+         cout << "Hidden communication time per apply: " << hidden_max
+              << " (" << hidden_min << ") sec.\n" << endl;
+      }
    }
 
+   res.size = size;
+   res.cg_iters = cg_iters;
+   res.cg_time_min = cg_rt_min;
+   res.cg_time_max = cg_rt_max;
+
    // Check relative error in solution
    a->RecoverFEMSolution(X, b, x);
 #if PROBLEM == 3
@@ -687,17 +2133,47 @@ int main(int argc, char *argv[])
       }
    }
 #endif
-   ConstantCoefficient zero_coefficient(0.0);
-#if PROBLEM == 2 || PROBLEM == 4
-   VectorGridFunctionCoefficient x0_coefficient(&x0);
+#ifdef USE_MPI_WTIME
+   my_rt_start = MPI_Wtime();
+#else
+   tic_toc.Clear();
+   tic_toc.Start();
+#endif
+   double norm_x0, norm_err;
+   ComputeL2Norms<HPCErrorForm>(*fespace, x0, x, norm_x0, norm_err);
+#ifdef USE_MPI_WTIME
+   my_rt = MPI_Wtime() - my_rt_start;
 #else
-   GridFunctionCoefficient x0_coefficient(&x0);
+   tic_toc.Stop();
+   my_rt = tic_toc.RealTime();
 #endif
-   const double norm_x0 = x0.ComputeL2Error(zero_coefficient);
-   const double norm_err = x.ComputeL2Error(x0_coefficient);
+   MPI_Reduce(&my_rt, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0, pmesh->GetComm());
+   res.rel_error = norm_err / norm_x0;
    if (myid == 0)
    {
-      cout << "Relative error: " << norm_err / norm_x0 << endl;
+      cout << "Relative error: " << res.rel_error << " (computed in "
+           << rt_max << " sec.)" << endl;
+   }
+
+   // Write the mesh, the quadrature data and the solution to a checkpoint
+   if (opt.checkpoint_file[0] != '\0')
+   {
+      Vector X_out;
+      x.GetTrueDofs(X_out);
+      long long ck_size;
+      double ck_time;
+      if (WriteCheckpoint(opt.checkpoint_file, ck_header, *pmesh,
+                          a->GetAssembledData(), a->GetAssembledDataSize(),
+                          X_out, ck_size, ck_time))
+      {
+         MPI_Reduce(&ck_time, &rt_max, 1, MPI_DOUBLE, MPI_MAX, 0,
+                    pmesh->GetComm());
+         if (myid == 0)
+         {
+            cout << "Checkpoint write: " << ck_size << " bytes, " << rt_max
+                 << " s, " << 1e-9*ck_size/rt_max << " GB/s." << endl;
+         }
+      }
    }
 
    // Send the solution by socket to a GLVis server.
@@ -713,6 +2189,12 @@ int main(int argc, char *argv[])
    }
 
    // Free the used memory.
+   delete thr_sys_oper;
+   delete thr_oper;
+   delete ovl_sys_oper;
+   delete ovl_oper;
+   delete a_f_oper;
+   delete a_f;
    delete a;
    if (A_pc) { delete A_pc; }
    if (a_pc) { delete a_pc; }
@@ -724,7 +2206,354 @@ int main(int argc, char *argv[])
    delete pmesh;
    delete pcg;
 
+   return 0;
+}
+
+// Registry of the compiled RunBP instances
+typedef int (*RunBPFunction)(MPI_Comm, const BPOptions &, int, BPResult &);
+struct BPInstance
+{
+   int sol_p, ir_order;
+   RunBPFunction run;
+};
+#define BP_INSTANCE(p,q) { p, q, RunBP<p,q> },
+const BPInstance bp_registry[] = { BP_INSTANCES };
+#undef BP_INSTANCE
+const int bp_num_instances = sizeof(bp_registry)/sizeof(bp_registry[0]);
+
+int main(int argc, char *argv[])
+{
+   // Initialize MPI.
+   int num_procs, myid;
+   MPI_Init(&argc, &argv);
+   MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+   MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+
+   // Parse command-line options.
+   int order = -1;
+   int ir_order = -1;
+   int el_per_proc = 1;
+   Array<int> el_per_proc_list;
+   int global_el = 0;
+   Array<int> num_procs_list;
+   double tol = 1e-6;
+   int max_iters = 500;
+   const char *pc = "none";
+   const char *solver = "cg";
+   double ir_inner_tol = 1e-3;
+   int ir_max_outer = 20;
+   bool overlap = false;
+   bool threaded = false;
+   const char *memory = "default";
+   bool tlb_misses = false;
+   int num_solves = 1;
+   int num_rhs = 1;
+   const char *checkpoint_file = "";
+   const char *restart_file = "";
+   bool essential_bcs = true;
+   bool visualization = 1;
+
+   OptionsParser args(argc, argv);
+   args.AddOption(&order, "-o", "--order",
+                  "Solution order; the default is the compiled order for a "
+                  "single-order build, otherwise 3.");
+   args.AddOption(&ir_order, "-ir", "--ir-order",
+                  "Integration rule order; the default is the compiled "
+                  "order for a single-order build, otherwise 2*order+3.");
+   args.AddOption(&el_per_proc, "-e", "--num-el-per-proc",
+                  "Number of elements per MPI rank.");
+   args.AddOption(&el_per_proc_list, "-es", "--num-el-per-proc-sweep",
+                  "Weak scaling sweep: list of numbers of elements per MPI "
+                  "rank, e.g. \"1 8 64\".");
+   args.AddOption(&global_el, "-ge", "--global-num-el",
+                  "Strong scaling sweep: fixed global number of elements, "
+                  "used with --num-procs-sweep.");
+   args.AddOption(&num_procs_list, "-ps", "--num-procs-sweep",
+                  "Strong scaling sweep: list of numbers of MPI ranks used "
+                  "for the points; the default is all ranks.");
+   args.AddOption(&tol, "-tol", "--pcg-rel-tol",
+                  "Relative tolerance for PCG convergence.");
+   args.AddOption(&max_iters, "-i", "--max-iters",
+                  "Maximum number of PCG iterations.");
+   args.AddOption(&pc, "-pc", "--preconditioner",
+                  "Preconditioner: "
+                  "lor - low-order-refined (matrix-free) AMG, "
+                  "ho - high-order (assembled) AMG, "
+                  "jacobi, "
+                  "lumpedmass, "
+                  "none.");
+   args.AddOption(&solver, "-solver", "--solver",
+                  "Solver: "
+                  "cg - MFEM's CGSolver, "
+                  "cg-fused - CG with fused vector operations, "
+                  "cg-sr - single-reduction (Chronopoulos-Gear) CG, "
+                  "ir-mixed - iterative refinement with inner PCG solves "
+                  "using a single precision operator (double precision "
+                  "vectors); not with --overlap or --openmp.");
+   args.AddOption(&ir_inner_tol, "-ir-tol", "--ir-inner-rel-tol",
+                  "Relative tolerance for the inner PCG solves of ir-mixed.");
+   args.AddOption(&ir_max_outer, "-ir-i", "--ir-max-outer-iters",
+                  "Maximum number of outer iterations of ir-mixed.");
+   args.AddOption(&overlap, "-ovl", "--overlap", "-no-ovl", "--no-overlap",
+                  "Overlap the shared-dof exchange with the interior element "
+                  "computations in the operator apply of the solver.");
+   args.AddOption(&threaded, "-omp", "--openmp", "-no-omp", "--no-openmp",
+                  "Use the OpenMP-threaded element loop, with OMP_NUM_THREADS "
+                  "threads per rank, in the operator apply of the solver.");
+   args.AddOption(&memory, "-mem", "--memory-mode",
+                  "Placement of the solver vectors (with cg-fused and cg-sr): "
+                  "default - MFEM's allocation, "
+                  "first-touch - touched first by the computing threads, "
+                  "thp - first-touch on transparent huge pages, "
+                  "hugetlb - first-touch on explicit 2 MiB huge pages.");
+   args.AddOption(&tlb_misses, "-tlb", "--tlb-misses", "-no-tlb",
+                  "--no-tlb-misses",
+                  "Count the data TLB load misses in the solve (Linux).");
+   args.AddOption(&num_solves, "-nsolves", "--num-solves",
+                  "Number of repeated solves with the same setup; the heap "
+                  "allocations of the first and of the later solves are "
+                  "reported.");
+   args.AddOption(&num_rhs, "-nrhs", "--num-rhs",
+                  "Number of right-hand sides (BP1 and BP3): with k > 1, solve "
+                  "k right-hand sides with a batched operator and block CG, "
+                  "and compare with k separate solves; k must be the compiled "
+                  "NRHS value.");
+   args.AddOption(&checkpoint_file, "-ck", "--checkpoint",
+                  "Write the mesh, the quadrature data and the solution to "
+                  "this file with MPI-IO.");
+   args.AddOption(&restart_file, "-rst", "--restart",
+                  "Read the mesh and the quadrature data from this checkpoint, "
+                  "skipping the mesh refinement and the assembly; requires "
+                  "the same number of ranks.");
+   args.AddOption(&essential_bcs, "-ess-bc", "--essential-bcs",
+                  "-nat-bc", "--natural-bcs",
+                  "Essential or natural boundary conditions.");
+   args.AddOption(&visualization, "-vis", "--visualization", "-no-vis",
+                  "--no-visualization",
+                  "Enable or disable GLVis visualization.");
+   args.Parse();
+   if (!args.Good())
+   {
+      if (myid == 0)
+      {
+         args.PrintUsage(cout);
+      }
+      MPI_Finalize();
+      return 1;
+   }
+   if (myid == 0)
+   {
+      args.PrintOptions(cout);
+   }
+
+   PCType pc_choice;
+   if (!strcmp(pc, "ho"))          { pc_choice = HO; }
+   else if (!strcmp(pc, "lor"))    { pc_choice = LOR; }
+   else if (!strcmp(pc, "jacobi")) { pc_choice = JACOBI; }
+   else if (!strcmp(pc, "lumpedmass")) { pc_choice = LUMPEDMASS; }
+   else if (!strcmp(pc, "none"))   { pc_choice = NONE; }
+   else
+   {
+      mfem_error("Invalid preconditioner specified");
+      return 3;
+   }
+
+   MFEM_VERIFY(!(overlap && threaded),
+               "--overlap and --openmp can not be combined");
+   // The checkpoint holds the quadrature data of the full local form, which is
+   // not assembled when the element subset operators replace it
+   MFEM_VERIFY(!(overlap || threaded) || (!checkpoint_file[0] &&
+                                          !restart_file[0]),
+               "--checkpoint and --restart can not be used with --overlap or "
+               "--openmp");
+   MFEM_VERIFY(num_solves >= 1, "--num-solves must be positive");
+#ifndef _OPENMP
+   if (threaded && myid == 0)
+   {
+      cout << "Warning: built without OpenMP, --openmp uses one thread per "
+           << "rank." << endl;
+   }
+#endif
+
+   MemoryMode memory_mode;
+   if (!strcmp(memory, "default"))          { memory_mode = MEM_DEFAULT; }
+   else if (!strcmp(memory, "first-touch")) { memory_mode = MEM_FIRST_TOUCH; }
+   else if (!strcmp(memory, "thp"))         { memory_mode = MEM_THP; }
+   else if (!strcmp(memory, "hugetlb"))     { memory_mode = MEM_HUGETLB; }
+   else
+   {
+      mfem_error("Invalid memory mode specified");
+      return 3;
+   }
+
+   if (num_rhs > 1)
+   {
+      MFEM_VERIFY(!vec, "--num-rhs requires BP1 or BP3");
+      MFEM_VERIFY(num_rhs == NRHS, "--num-rhs must be the compiled NRHS value, "
+                  << NRHS << "; recompile with suitable 'nrhs' value");
+      MFEM_VERIFY(pc_choice == NONE, "--num-rhs requires --preconditioner none");
+      MFEM_VERIFY(PROBLEM != 3 || essential_bcs,
+                  "--num-rhs requires essential boundary conditions for BP3");
+      MFEM_VERIFY(!checkpoint_file[0] && !restart_file[0],
+                  "--num-rhs can not be used with --checkpoint or --restart");
+   }
+
+   SolverType solver_choice;
+   if (!strcmp(solver, "cg"))            { solver_choice = SolverType::CG; }
+   else if (!strcmp(solver, "cg-fused")) { solver_choice = CG_FUSED; }
+   else if (!strcmp(solver, "cg-sr"))    { solver_choice = CG_SR; }
+   else if (!strcmp(solver, "ir-mixed")) { solver_choice = IR_MIXED; }
+   else
+   {
+      mfem_error("Invalid solver specified");
+      return 3;
+   }
+   // The inner solves of ir-mixed use the single precision form, which has
+   // neither the threaded element loop nor the overlapped communication
+   MFEM_VERIFY(solver_choice != IR_MIXED || !(overlap || threaded),
+               "--solver ir-mixed can not be combined with --overlap or "
+               "--openmp");
+
+   // Select the compiled instance for the requested orders
+   if (order < 0)
+   {
+      order = (bp_num_instances == 1) ? bp_registry[0].sol_p : 3;
+   }
+   if (ir_order < 0)
+   {
+      ir_order = (bp_num_instances == 1 && order == bp_registry[0].sol_p) ?
+                 bp_registry[0].ir_order : 2*order+3;
+   }
+   RunBPFunction run_bp = NULL;
+   for (int i = 0; i < bp_num_instances; i++)
+   {
+      if (bp_registry[i].sol_p == order && bp_registry[i].ir_order == ir_order)
+      {
+         run_bp = bp_registry[i].run;
+      }
+   }
+   if (!run_bp)
+   {
+      if (myid == 0)
+      {
+         cout << "Solution order " << order << " with integration rule order "
+              << ir_order << " is not compiled in. Available (order, "
+              << "ir_order):";
+         for (int i = 0; i < bp_num_instances; i++)
+         {
+            cout << " (" << bp_registry[i].sol_p << ", "
+                 << bp_registry[i].ir_order << ")";
+         }
+         cout << "\nRecompile with suitable 'sol_p' and 'ir_order' values."
+              << endl;
+      }
+      MPI_Finalize();
+      return 5;
+   }
+
+   BPOptions opt;
+   opt.tol = tol;
+   opt.max_iters = max_iters;
+   opt.pc_choice = pc_choice;
+   opt.solver_choice = solver_choice;
+   opt.ir_inner_tol = ir_inner_tol;
+   opt.ir_max_outer = ir_max_outer;
+   opt.overlap = overlap;
+   opt.threaded = threaded;
+   opt.memory_mode = memory_mode;
+   opt.tlb_misses = tlb_misses;
+   opt.num_solves = num_solves;
+   opt.num_rhs = num_rhs;
+   opt.checkpoint_file = checkpoint_file;
+   opt.restart_file = restart_file;
+   opt.essential_bcs = essential_bcs;
+   opt.visualization = visualization;
+
+   // List of (number of ranks, elements per rank) points: a single point by
+   // default, a weak scaling sweep with --num-el-per-proc-sweep, or a strong
+   // scaling sweep with --global-num-el.
+   Array<int> point_procs, point_el;
+   if (global_el > 0)
+   {
+      if (num_procs_list.Size() == 0) { num_procs_list.Append(num_procs); }
+      for (int i = 0; i < num_procs_list.Size(); i++)
+      {
+         const int np = num_procs_list[i];
+         if (np < 1 || np > num_procs || global_el % np != 0)
+         {
+            if (myid == 0)
+            {
+               cout << "Invalid strong scaling point: " << global_el
+                    << " elements on " << np << " ranks." << endl;
+            }
+            MPI_Finalize();
+            return 6;
+         }
+         point_procs.Append(np);
+         point_el.Append(global_el / np);
+      }
+   }
+   else if (el_per_proc_list.Size() > 0)
+   {
+      for (int i = 0; i < el_per_proc_list.Size(); i++)
+      {
+         point_procs.Append(num_procs);
+         point_el.Append(el_per_proc_list[i]);
+      }
+   }
+   else
+   {
+      point_procs.Append(num_procs);
+      point_el.Append(el_per_proc);
+   }
+   const int num_points = point_procs.Size();
+   MFEM_VERIFY(num_points == 1 || (!checkpoint_file[0] && !restart_file[0]),
+               "--checkpoint and --restart can not be used with sweeps");
+
+   // Run the points, each one on a communicator with the first point_procs[i]
+   // ranks; the remaining ranks wait for the next point.
+   vector<BPResult> results(num_points);
+   int ret = 0;
+   for (int i = 0; i < num_points && ret == 0; i++)
+   {
+      if (myid == 0 && num_points > 1)
+      {
+         cout << "\nSweep point " << i+1 << " of " << num_points << ": "
+              << point_procs[i] << " ranks, " << point_el[i]
+              << " elements per rank\n" << endl;
+      }
+      MPI_Comm comm;
+      MPI_Comm_split(MPI_COMM_WORLD, myid < point_procs[i] ? 0 : MPI_UNDEFINED,
+                     myid, &comm);
+      if (comm != MPI_COMM_NULL)
+      {
+         ret = run_bp(comm, opt, point_el[i], results[i]);
+         MPI_Comm_free(&comm);
+      }
+      MPI_Bcast(&ret, 1, MPI_INT, 0, MPI_COMM_WORLD);
+   }
+
+   if (myid == 0 && num_points > 1 && ret == 0)
+   {
+      cout << "\nSweep summary:\n"
+           << setw(8) << "ranks" << setw(12) << "el/rank"
+           << setw(14) << "DOFs" << setw(10) << "CG iters"
+           << setw(14) << "CG time" << setw(14) << "DOFs/sec"
+           << setw(14) << "rel. error" << endl;
+      for (int i = 0; i < num_points; i++)
+      {
+         const BPResult &r = results[i];
+         cout << setw(8) << point_procs[i] << setw(12) << point_el[i]
+              << setw(14) << r.size << setw(10) << r.cg_iters
+              << setw(14) << r.cg_time_max
+              << setw(14) << 1e-6*r.size*r.cg_iters/r.cg_time_max
+              << setw(14) << r.rel_error << endl;
+      }
+      cout << "(CG time is the max over ranks, in sec, of the inner solves "
+           << "with ir-mixed; DOFs/sec in millions)" << endl;
+   }
+
    MPI_Finalize();
 
-   return 0;
+   return ret;
 }
@@ -21,6 +21,15 @@ function configure_tests()
    ir_order_list=(5  7  9  11  13  15  17  19  3  5)
    el_per_proc_list=(1 2 4 8 16 32 64 128 256 512 1024)
    pc=${pc:-none}
+   solver=${solver:-cg}
+   overlap=${overlap:-no}
+   openmp=${openmp:-no}
+   memory=${memory:-default}
+   tlb=${tlb:-no}
+   # Number of right-hand sides (BP1 and BP3, without a preconditioner)
+   nrhs=${nrhs:-1}
+   sweep=${sweep:-no}
+   multi_order=${multi_order:-no}
    bcs=${bcs:-essential}
 }
 
@@ -32,9 +41,19 @@ function build_tests()
 
    # Initialize build arguments
    local make_extra=("PROBLEM=${problem}" "sol_p=${sol_p_list[*]}" "ir_order=${ir_order_list[*]}" "USE_MPI_WTIME=1")
-   make_extra=("${make_extra[@]}" "EXTRA_CXXFLAGS=$TEST_EXTRA_CFLAGS")
+   local extra_cxxflags="$TEST_EXTRA_CFLAGS"
+   if [[ "$openmp" == "yes" ]]; then
+      extra_cxxflags+=" ${OPENMP_CFLAG:--fopenmp}"
+   fi
+   make_extra=("${make_extra[@]}" "EXTRA_CXXFLAGS=$extra_cxxflags")
    make_extra=("${make_extra[@]}" "MFEM_DIR=$MFEM_DIR")
    make_extra=("${make_extra[@]}" "BLD=$test_exe_dir/")
+   if [[ "$multi_order" == "yes" ]]; then
+      make_extra=("${make_extra[@]}" "multi_order=1")
+   fi
+   if [[ "$nrhs" -gt 1 ]]; then
+      make_extra=("${make_extra[@]}" "nrhs=$nrhs")
+   fi
 
    # Clear previous builds if needed
    case "$rebuild_tests" in
@@ -57,20 +76,73 @@ function run_tests()
    # Initialize MPI options
    set_mpi_options
 
-   # Iterate through test configurations
+   # Common arguments
+   local common_args="--no-visualization"
+   common_args="${common_args} --${bcs}-bcs"
+   common_args="${common_args} --preconditioner ${pc}"
+   common_args="${common_args} --solver ${solver}"
+   if [[ "$overlap" == "yes" ]]; then
+      common_args="${common_args} --overlap"
+   fi
+   if [[ "$openmp" == "yes" ]]; then
+      common_args="${common_args} --openmp"
+   fi
+   common_args="${common_args} --memory-mode ${memory}"
+   if [[ "$tlb" == "yes" ]]; then
+      common_args="${common_args} --tlb-misses"
+   fi
+   if [[ "$nrhs" -gt 1 ]]; then
+      common_args="${common_args} --num-rhs ${nrhs}"
+   fi
+
+   # With huge pages, also let malloc (quadrature data, hypre matrices) use
+   # them; requires glibc 2.35 or newer, ignored otherwise.
+   local run_env=""
+   case "$memory" in
+      thp)     run_env="env GLIBC_TUNABLES=glibc.malloc.hugetlb=1" ;;
+      hugetlb) run_env="env GLIBC_TUNABLES=glibc.malloc.hugetlb=2" ;;
+   esac
+
+   # Executable name and order arguments for test configuration i; with
+   # multi_order=yes, a single executable contains all orders.
+   local test_names=() order_args=()
    local num_exes=${#sol_p_list[@]}
+   for ((i = 0; i < num_exes; i++)) do
+      if [[ "$multi_order" == "yes" ]]; then
+         test_names[i]=bp${problem}
+         order_args[i]="--order ${sol_p_list[i]} --ir-order ${ir_order_list[i]}"
+      else
+         test_names[i]=bp${problem}_solp${sol_p_list[i]}_irorder${ir_order_list[i]}
+         order_args[i]=""
+      fi
+   done
+
+   # Iterate through test configurations; with sweep=yes, all sizes in
+   # el_per_proc_list are run by a single launch of each executable.
+   if [[ "$sweep" == "yes" ]]; then
+      for ((i = 0; i < num_exes; i++)) do
+         local test_name=${test_names[i]}
+         local all_args="${common_args} ${order_args[i]}"
+         if [ -z "$dry_run" ]; then
+            echo "Running test:"
+            quoted_echo $mpi_run $run_env ./$test_name $all_args \
+               --num-el-per-proc-sweep "${el_per_proc_list[*]}"
+            $mpi_run $run_env ./$test_name $all_args \
+               --num-el-per-proc-sweep "${el_per_proc_list[*]}"
+         fi
+      done
+      return
+   fi
    local el_per_proc_list_size=${#el_per_proc_list[@]}
    for ((j = 0; j < el_per_proc_list_size; j++)) do
       for ((i = 0; i < num_exes; i++)) do
-         local test_name=bp${problem}_solp${sol_p_list[i]}_irorder${ir_order_list[i]}
-         local all_args="--no-visualization"
+         local test_name=${test_names[i]}
+         local all_args="${common_args} ${order_args[i]}"
          all_args="${all_args} --num-el-per-proc ${el_per_proc_list[j]}"
-         all_args="${all_args} --${bcs}-bcs"
-         all_args="${all_args} --preconditioner ${pc}"
          if [ -z "$dry_run" ]; then
             echo "Running test:"
-            quoted_echo $mpi_run ./$test_name $all_args
-            $mpi_run ./$test_name $all_args
+            quoted_echo $mpi_run $run_env ./$test_name $all_args
+            $mpi_run $run_env ./$test_name $all_args
          fi
       done
    done
@@ -0,0 +1,484 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project
+// (17-SC-20-SC), a collaborative effort of two U.S. Department of Energy
+// organizations (Office of Science and the National Nuclear Security
+// Administration) responsible for the planning and preparation of a capable
+// exascale ecosystem, including software, applications, hardware, advanced
+// system engineering and early testbed platforms, in support of the nation's
+// exascale computing imperative.
+
+// Conjugate gradient solvers shared by the MFEM bake-off drivers,
+// mfem_bps/bp1_v1.cpp and mfem_bps_v2/bp.cpp. The makefiles add this directory
+// to the include path.
+
+#ifndef CEED_BENCHMARKS_CG_SOLVERS_HPP
+#define CEED_BENCHMARKS_CG_SOLVERS_HPP
+
+#include <mfem.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+// Conjugate gradient solver with fused vector operations. Compared to MFEM's
+// CGSolver, the updates of the solution and the residual are done in a single
+// sweep which also computes the new residual inner product, and a diagonal
+// preconditioner (if given) is applied inside the same sweep. Outside of the
+// operator and the preconditioner, each iteration makes three passes over the
+// full-length vectors instead of five. The sweeps are threaded with OpenMP,
+// when enabled.
+class FusedCGSolver : public mfem::IterativeSolver
+{
+protected:
+   mutable mfem::Vector r, d, q, s;
+   mfem::Vector dinv;
+
+   double GlobalSum(double loc) const
+   {
+      double glob;
+      MPI_Allreduce(&loc, &glob, 1, MPI_DOUBLE, MPI_SUM, comm);
+      return glob;
+   }
+
+public:
+   FusedCGSolver(MPI_Comm comm_) : mfem::IterativeSolver(comm_) { }
+
+   virtual void SetOperator(const mfem::Operator &op)
+   {
+      mfem::IterativeSolver::SetOperator(op);
+      r.SetSize(width);
+      d.SetSize(width);
+      q.SetSize(width);
+      if (prec) { s.SetSize(width); }
+   }
+
+   virtual void SetPreconditioner(mfem::Solver &pr)
+   {
+      mfem::IterativeSolver::SetPreconditioner(pr);
+      dinv.Destroy();
+      s.SetSize(width);
+   }
+
+   // Use the diagonal preconditioner D^{-1}, applied inside the fused sweeps.
+   void SetDiagonalPreconditioner(const mfem::Vector &diag)
+   {
+      prec = NULL;
+      s.Destroy();
+      dinv.SetSize(diag.Size());
+      for (int j = 0; j < diag.Size(); j++) { dinv(j) = 1.0/diag(j); }
+   }
+
+   // Number of full-length vector reads and writes per iteration, not counting
+   // the operator and any non-diagonal preconditioner.
+   int GetVectorTraffic() const { return (prec || dinv.Size()) ? 13 : 11; }
+
+   // Move the work vectors to placed storage, e.g. with VectorPlacement in
+   // bp.cpp; call after setting the operator and the preconditioner.
+   template <class Placement>
+   void PlaceVectors(Placement &vp)
+   {
+      vp.Place(r);
+      vp.Place(d);
+      vp.Place(q);
+      vp.Place(s);
+      vp.Place(dinv);
+   }
+
+   virtual void Mult(const mfem::Vector &b, mfem::Vector &x) const
+   {
+      const int n = width;
+      const double *id = dinv.Size() ? dinv.GetData() : NULL;
+      double *xd = x.GetData(), *rd = r.GetData(), *dd = d.GetData();
+      double *qd = q.GetData(), *sd = s.GetData();
+      double nom, nom0, betanom, den, alpha, beta;
+
+      if (iterative_mode)
+      {
+         oper->Mult(x, r);
+         mfem::subtract(b, r, r); // r = b - A x
+      }
+      else
+      {
+         r = b;
+         x = 0.0;
+      }
+
+      if (prec)
+      {
+         prec->Mult(r, s);
+         d = s;
+         nom = Dot(r, s);
+      }
+      else if (id)
+      {
+         double loc = 0.0;
+         #pragma omp parallel for reduction(+:loc)
+         for (int j = 0; j < n; j++)
+         {
+            dd[j] = id[j]*rd[j];
+            loc += rd[j]*dd[j];
+         }
+         nom = GlobalSum(loc);
+      }
+      else
+      {
+         d = r;
+         nom = Dot(r, r);
+      }
+      nom0 = betanom = nom;
+
+      if (print_level == 1 || print_level == 3)
+      {
+         std::cout << "   Iteration : " << std::setw(3) << 0 << "  (B r, r) = "
+                   << nom << (print_level == 3 ? " ...\n" : "\n");
+      }
+
+      const double r0 = std::max(nom*rel_tol*rel_tol, abs_tol*abs_tol);
+      if (nom <= r0)
+      {
+         converged = 1;
+         final_iter = 0;
+         final_norm = std::sqrt(nom);
+         return;
+      }
+
+      oper->Mult(d, q); // q = A d
+      den = Dot(d, q);
+      if (den <= 0.0)
+      {
+         if (print_level >= 0)
+         {
+            std::cout << "Non-positive denominator in step 0 of PCG: " << den
+                      << '\n';
+         }
+         converged = 0;
+         final_iter = 0;
+         final_norm = std::sqrt(nom);
+         return;
+      }
+
+      converged = 0;
+      for (int i = 1; true; i++)
+      {
+         alpha = nom/den;
+
+         // x += alpha d, r -= alpha q, and the new (B r, r) in one sweep
+         double loc = 0.0;
+         if (id)
+         {
+            #pragma omp parallel for reduction(+:loc)
+            for (int j = 0; j < n; j++)
+            {
+               xd[j] += alpha*dd[j];
+               const double rj = rd[j] - alpha*qd[j];
+               rd[j] = rj;
+               loc += id[j]*rj*rj;
+            }
+         }
+         else
+         {
+            #pragma omp parallel for reduction(+:loc)
+            for (int j = 0; j < n; j++)
+            {
+               xd[j] += alpha*dd[j];
+               const double rj = rd[j] - alpha*qd[j];
+               rd[j] = rj;
+               loc += rj*rj;
+            }
+         }
+         if (prec)
+         {
+            prec->Mult(r, s);
+            betanom = Dot(r, s);
+         }
+         else
+         {
+            betanom = GlobalSum(loc);
+         }
+
+         if (print_level == 1)
+         {
+            std::cout << "   Iteration : " << std::setw(3) << i
+                      << "  (B r, r) = " << betanom << '\n';
+         }
+         if (betanom <= r0)
+         {
+            if (print_level == 2)
+            {
+               std::cout << "Number of PCG iterations: " << i << '\n';
+            }
+            else if (print_level == 3)
+            {
+               std::cout << "   Iteration : " << std::setw(3) << i
+                         << "  (B r, r) = " << betanom << '\n';
+            }
+            converged = 1;
+            final_iter = i;
+            break;
+         }
+         if (i >= max_iter)
+         {
+            final_iter = i;
+            break;
+         }
+
+         // d = B r + beta d in one sweep
+         beta = betanom/nom;
+         if (prec)
+         {
+            #pragma omp parallel for
+            for (int j = 0; j < n; j++) { dd[j] = sd[j] + beta*dd[j]; }
+         }
+         else if (id)
+         {
+            #pragma omp parallel for
+            for (int j = 0; j < n; j++) { dd[j] = id[j]*rd[j] + beta*dd[j]; }
+         }
+         else
+         {
+            #pragma omp parallel for
+            for (int j = 0; j < n; j++) { dd[j] = rd[j] + beta*dd[j]; }
+         }
+
+         oper->Mult(d, q); // q = A d
+         den = Dot(d, q);
+         if (den <= 0.0)
+         {
+            if (print_level >= 0 && Dot(d, d) > 0.0)
+            {
+               std::cout << "PCG: The operator is not positive definite. "
+                         << "(Ad, d) = " << den << '\n';
+            }
+         }
+         nom = betanom;
+      }
+      if (print_level >= 0 && !converged)
+      {
+         std::cout << "PCG: No convergence!" << '\n';
+      }
+      if (print_level >= 1 || (print_level >= 0 && !converged))
+      {
+         std::cout << "Average reduction factor = "
+                   << std::pow(betanom/nom0, 0.5/final_iter) << '\n';
+      }
+      final_norm = std::sqrt(betanom);
+   }
+};
+
+// Single-reduction (Chronopoulos-Gear) conjugate gradient solver. The two inner
+// products of each iteration, (B r, r) and (A B r, B r), are computed together
+// after the operator application and combined in a single MPI_Allreduce. The
+// recurrences for the search direction p and for s = A p are updated in the
+// same sweep as x and r, threaded with OpenMP when enabled. The convergence
+// check and the iteration reporting are the same as in MFEM's CGSolver.
+class SingleReductionCGSolver : public mfem::IterativeSolver
+{
+protected:
+   mutable mfem::Vector r, u, w, p, s;
+   mfem::Vector dinv;
+
+   // Local parts of (r, u) and (w, u), in one sweep
+   static void LocalDots(int n, const double *rd, const double *ud,
+                         const double *wd, double *dots)
+   {
+      double ru = 0.0, wu = 0.0;
+      #pragma omp parallel for reduction(+:ru,wu)
+      for (int j = 0; j < n; j++)
+      {
+         ru += rd[j]*ud[j];
+         wu += wd[j]*ud[j];
+      }
+      dots[0] = ru;
+      dots[1] = wu;
+   }
+
+public:
+   SingleReductionCGSolver(MPI_Comm comm_) : mfem::IterativeSolver(comm_) { }
+
+   virtual void SetOperator(const mfem::Operator &op)
+   {
+      mfem::IterativeSolver::SetOperator(op);
+      r.SetSize(width);
+      w.SetSize(width);
+      p.SetSize(width);
+      s.SetSize(width);
+      if (prec || dinv.Size()) { u.SetSize(width); }
+   }
+
+   virtual void SetPreconditioner(mfem::Solver &pr)
+   {
+      mfem::IterativeSolver::SetPreconditioner(pr);
+      dinv.Destroy();
+      u.SetSize(width);
+   }
+
+   // Use the diagonal preconditioner D^{-1}, applied inside the fused sweeps.
+   void SetDiagonalPreconditioner(const mfem::Vector &diag)
+   {
+      prec = NULL;
+      dinv.SetSize(diag.Size());
+      for (int j = 0; j < diag.Size(); j++) { dinv(j) = 1.0/diag(j); }
+      u.SetSize(width);
+   }
+
+   // Number of full-length vector reads and writes per iteration, not counting
+   // the operator and any non-diagonal preconditioner.
+   int GetVectorTraffic() const { return dinv.Size() ? 15 : (prec ? 13 : 11); }
+
+   // Move the work vectors to placed storage, e.g. with VectorPlacement in
+   // bp.cpp; call after setting the operator and the preconditioner.
+   template <class Placement>
+   void PlaceVectors(Placement &vp)
+   {
+      vp.Place(r);
+      vp.Place(u);
+      vp.Place(w);
+      vp.Place(p);
+      vp.Place(s);
+      vp.Place(dinv);
+   }
+
+   virtual void Mult(const mfem::Vector &b, mfem::Vector &x) const
+   {
+      const int n = width;
+      const double *id = dinv.Size() ? dinv.GetData() : NULL;
+      // Without a preconditioner, u = B r is just r
+      mfem::Vector &bu = (prec || id) ? u : r;
+      double *xd = x.GetData(), *rd = r.GetData(), *ud = bu.GetData();
+      double *wd = w.GetData(), *pd = p.GetData(), *sd = s.GetData();
+      double dots[2], gamma, gamma0, delta, alpha, beta = 0.0;
+
+      if (iterative_mode)
+      {
+         oper->Mult(x, r);
+         mfem::subtract(b, r, r); // r = b - A x
+      }
+      else
+      {
+         r = b;
+         x = 0.0;
+      }
+      if (prec) { prec->Mult(r, u); }
+      else if (id)
+      {
+         #pragma omp parallel for
+         for (int j = 0; j < n; j++) { ud[j] = id[j]*rd[j]; }
+      }
+      oper->Mult(bu, w); // w = A u
+
+      LocalDots(n, rd, ud, wd, dots);
+      MPI_Allreduce(MPI_IN_PLACE, dots, 2, MPI_DOUBLE, MPI_SUM, comm);
+      gamma0 = gamma = dots[0];
+      delta = dots[1];
+
+      if (print_level == 1 || print_level == 3)
+      {
+         std::cout << "   Iteration : " << std::setw(3) << 0 << "  (B r, r) = "
+                   << gamma << (print_level == 3 ? " ...\n" : "\n");
+      }
+
+      const double r0 = std::max(gamma*rel_tol*rel_tol, abs_tol*abs_tol);
+      if (gamma <= r0)
+      {
+         converged = 1;
+         final_iter = 0;
+         final_norm = std::sqrt(gamma);
+         return;
+      }
+      if (delta <= 0.0)
+      {
+         if (print_level >= 0)
+         {
+            std::cout << "Non-positive denominator in step 0 of PCG: " << delta
+                      << '\n';
+         }
+         converged = 0;
+         final_iter = 0;
+         final_norm = std::sqrt(gamma);
+         return;
+      }
+      alpha = gamma/delta;
+
+      converged = 0;
+      for (int i = 1; true; i++)
+      {
+         // p = u + beta p, s = w + beta s, x += alpha p, r -= alpha s, and
+         // u = D^{-1} r for a diagonal preconditioner, in one sweep
+         #pragma omp parallel for
+         for (int j = 0; j < n; j++)
+         {
+            const double pj = (i == 1) ? ud[j] : ud[j] + beta*pd[j];
+            const double sj = (i == 1) ? wd[j] : wd[j] + beta*sd[j];
+            pd[j] = pj;
+            sd[j] = sj;
+            xd[j] += alpha*pj;
+            rd[j] -= alpha*sj;
+            if (id) { ud[j] = id[j]*rd[j]; }
+         }
+         if (prec) { prec->Mult(r, u); }
+         oper->Mult(bu, w); // w = A u
+
+         // (B r, r) and (A u, u) with a single global reduction
+         LocalDots(n, rd, ud, wd, dots);
+         MPI_Allreduce(MPI_IN_PLACE, dots, 2, MPI_DOUBLE, MPI_SUM, comm);
+
+         if (print_level == 1)
+         {
+            std::cout << "   Iteration : " << std::setw(3) << i
+                      << "  (B r, r) = " << dots[0] << '\n';
+         }
+         if (dots[0] <= r0)
+         {
+            if (print_level == 2)
+            {
+               std::cout << "Number of PCG iterations: " << i << '\n';
+            }
+            else if (print_level == 3)
+            {
+               std::cout << "   Iteration : " << std::setw(3) << i
+                         << "  (B r, r) = " << dots[0] << '\n';
+            }
+            gamma = dots[0];
+            converged = 1;
+            final_iter = i;
+            break;
+         }
+         if (i >= max_iter)
+         {
+            gamma = dots[0];
+            final_iter = i;
+            break;
+         }
+
+         beta = dots[0]/gamma;
+         delta = dots[1] - beta*dots[0]/alpha;
+         if (delta <= 0.0 && print_level >= 0)
+         {
+            std::cout << "PCG: The operator is not positive definite. "
+                      << "(Ap, p) = " << delta << '\n';
+         }
+         alpha = dots[0]/delta;
+         gamma = dots[0];
+      }
+      if (print_level >= 0 && !converged)
+      {
+         std::cout << "PCG: No convergence!" << '\n';
+      }
+      if (print_level >= 1 || (print_level >= 0 && !converged))
+      {
+         std::cout << "Average reduction factor = "
+                   << std::pow(gamma/gamma0, 0.5/final_iter) << '\n';
+      }
+      final_norm = std::sqrt(gamma);
+   }
+};
+
+#endif // CEED_BENCHMARKS_CG_SOLVERS_HPP
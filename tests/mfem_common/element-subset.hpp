@@ -0,0 +1,282 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project
+// (17-SC-20-SC), a collaborative effort of two U.S. Department of Energy
+// organizations (Office of Science and the National Nuclear Security
+// Administration) responsible for the planning and preparation of a capable
+// exascale ecosystem, including software, applications, hardware, advanced
+// system engineering and early testbed platforms, in support of the nation's
+// exascale computing imperative.
+
+// Element subset operators shared by the MFEM bake-off drivers,
+// mfem_bps/bp1_v1.cpp and mfem_bps_v2/bp.cpp. The bilinear form type form_t
+// provides Assemble() and Mult(x, y); the drivers create its instances on the
+// subset spaces with a function form_t *create(const FiniteElementSpace &).
+
+#ifndef CEED_BENCHMARKS_ELEMENT_SUBSET_HPP
+#define CEED_BENCHMARKS_ELEMENT_SUBSET_HPP
+
+#include <mfem.hpp>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Bilinear form restricted to a subset of the local elements of a parallel
+// finite element space. The elements are copied into a serial mesh, with the
+// nodes of the parallel mesh, and a serial finite element space. The vertices
+// keep their relative order, so the edge and face orientations, and with them
+// the element-local dof ordering, are the same in both spaces; 'ldof_map' maps
+// the local dofs of the subset space to the local dofs of the full space.
+// Assemble() must be called before the first apply.
+template <class form_t>
+class ElementSubsetOperator
+{
+protected:
+   mfem::Mesh *mesh;
+   mfem::FiniteElementSpace *fes;
+   form_t *form;
+   mfem::Array<int> ldof_map;
+   mutable mfem::Vector x_s, y_s;
+
+public:
+   ElementSubsetOperator(mfem::ParFiniteElementSpace &pfes,
+                         const mfem::Array<int> &elems,
+                         form_t *(*create)(const mfem::FiniteElementSpace &))
+      : mesh(NULL), fes(NULL), form(NULL)
+   {
+      if (elems.Size() == 0) { return; }
+
+      mfem::Mesh &pmesh = *pfes.GetMesh();
+      const int dim = pmesh.Dimension();
+      mfem::Array<int> vmap(pmesh.GetNV()), vlist, v;
+      vmap = -1;
+      for (int i = 0; i < elems.Size(); i++)
+      {
+         pmesh.GetElementVertices(elems[i], v);
+         for (int j = 0; j < v.Size(); j++)
+         {
+            if (vmap[v[j]] < 0) { vmap[v[j]] = 0; vlist.Append(v[j]); }
+         }
+      }
+      vlist.Sort();
+      for (int i = 0; i < vlist.Size(); i++) { vmap[vlist[i]] = i; }
+      mesh = new mfem::Mesh(dim, vlist.Size(), elems.Size(), 0,
+                            pmesh.SpaceDimension());
+      for (int i = 0; i < vlist.Size(); i++)
+      {
+         mesh->AddVertex(pmesh.GetVertex(vlist[i]));
+      }
+      for (int i = 0; i < elems.Size(); i++)
+      {
+         pmesh.GetElementVertices(elems[i], v);
+         for (int j = 0; j < v.Size(); j++) { v[j] = vmap[v[j]]; }
+         if (dim == 3) { mesh->AddHex(v, pmesh.GetAttribute(elems[i])); }
+         else { mesh->AddQuad(v, pmesh.GetAttribute(elems[i])); }
+      }
+      mesh->FinalizeTopology();
+      mesh->Finalize();
+      const mfem::GridFunction *pnodes = pmesh.GetNodes();
+      if (pnodes)
+      {
+         const mfem::FiniteElementSpace &pnfes = *pnodes->FESpace();
+         mesh->SetCurvature(pnfes.GetFE(0)->GetOrder(), false, -1,
+                            pnfes.GetOrdering());
+         mfem::GridFunction &snodes = *mesh->GetNodes();
+         mfem::Array<int> pvdofs, svdofs;
+         for (int i = 0; i < elems.Size(); i++)
+         {
+            pnfes.GetElementVDofs(elems[i], pvdofs);
+            snodes.FESpace()->GetElementVDofs(i, svdofs);
+            for (int j = 0; j < svdofs.Size(); j++)
+            {
+               snodes(svdofs[j]) = (*pnodes)(pvdofs[j]);
+            }
+         }
+      }
+
+      fes = new mfem::FiniteElementSpace(mesh, pfes.FEColl(), pfes.GetVDim(),
+                                         pfes.GetOrdering());
+      form = create(*fes);
+      mfem::Array<int> pvdofs, svdofs;
+      ldof_map.SetSize(fes->GetVSize());
+      for (int i = 0; i < elems.Size(); i++)
+      {
+         pfes.GetElementVDofs(elems[i], pvdofs);
+         fes->GetElementVDofs(i, svdofs);
+         for (int j = 0; j < svdofs.Size(); j++)
+         {
+            ldof_map[svdofs[j]] = pvdofs[j];
+         }
+      }
+      x_s.SetSize(fes->GetVSize());
+      y_s.SetSize(fes->GetVSize());
+   }
+
+   void Assemble() { if (form) { form->Assemble(); } }
+
+   // y_s = A_subset x_l restricted to the subset, where x_l is a local vector
+   // of the full space; the result is returned by GetSubsetResult().
+   void MultSubset(const mfem::Vector &x_l) const
+   {
+      if (!form) { return; }
+      const int n = ldof_map.Size();
+      for (int i = 0; i < n; i++) { x_s(i) = x_l(ldof_map[i]); }
+      form->Mult(x_s, y_s);
+   }
+
+   // y_l += A_subset x_l, where x_l and y_l are local vectors of the full space
+   void AddMult(const mfem::Vector &x_l, mfem::Vector &y_l) const
+   {
+      if (!form) { return; }
+      MultSubset(x_l);
+      const int n = ldof_map.Size();
+      for (int i = 0; i < n; i++) { y_l(ldof_map[i]) += y_s(i); }
+   }
+
+   const mfem::Array<int> &GetLDofMap() const { return ldof_map; }
+   const mfem::Vector &GetSubsetResult() const { return y_s; }
+
+   ~ElementSubsetOperator()
+   {
+      delete form;
+      delete fes;
+      delete mesh;
+   }
+};
+
+// Local (L-vector) operator with an OpenMP-threaded element loop. The local
+// elements are split, in Hilbert curve order, into one compact chunk per
+// thread, each with its own ElementSubsetOperator. Assemble() and Mult() use
+// the same static schedule, so the data of a chunk is first touched by the
+// thread that applies it. The dofs of a single chunk are written by the
+// threads in parallel; the dofs on the interfaces between the chunks are
+// summed afterwards. Without OpenMP, there is a single chunk.
+template <class form_t>
+class ThreadedElementOperator : public mfem::Operator
+{
+protected:
+   mfem::ParFiniteElementSpace &pfes;
+   mfem::Array<ElementSubsetOperator<form_t> *> chunks;
+   // Per chunk: the subset dofs only in this chunk, and those shared with
+   // other chunks; 'shared_ldof' lists the local dofs of the latter
+   mfem::Array<mfem::Array<int> *> excl_sdofs, shared_sdofs;
+   mfem::Array<int> shared_ldof;
+
+public:
+   ThreadedElementOperator(mfem::ParFiniteElementSpace &pfes_,
+                           form_t *(*create)(const mfem::FiniteElementSpace &))
+      : mfem::Operator(pfes_.GetVSize()), pfes(pfes_)
+   {
+      int num_chunks = 1;
+#ifdef _OPENMP
+      num_chunks = omp_get_max_threads();
+#endif
+      const int ne = pfes.GetNE();
+      num_chunks = std::max(1, std::min(num_chunks, ne));
+
+      // ordering[e] is the position of element e along the Hilbert curve
+      mfem::Array<int> ordering;
+      pfes.GetMesh()->GetHilbertElementOrdering(ordering);
+      mfem::Array<int> elems;
+      chunks.SetSize(num_chunks);
+      for (int t = 0; t < num_chunks; t++)
+      {
+         const int begin = (t*ne)/num_chunks, end = ((t+1)*ne)/num_chunks;
+         elems.SetSize(0);
+         for (int e = 0; e < ne; e++)
+         {
+            if (ordering[e] >= begin && ordering[e] < end) { elems.Append(e); }
+         }
+         chunks[t] = new ElementSubsetOperator<form_t>(pfes, elems, create);
+      }
+
+      const int lsize = pfes.GetVSize();
+      mfem::Array<int> count(lsize);
+      count = 0;
+      for (int t = 0; t < num_chunks; t++)
+      {
+         const mfem::Array<int> &ldof_map = chunks[t]->GetLDofMap();
+         for (int j = 0; j < ldof_map.Size(); j++) { count[ldof_map[j]]++; }
+      }
+      excl_sdofs.SetSize(num_chunks);
+      shared_sdofs.SetSize(num_chunks);
+      for (int t = 0; t < num_chunks; t++)
+      {
+         const mfem::Array<int> &ldof_map = chunks[t]->GetLDofMap();
+         excl_sdofs[t] = new mfem::Array<int>;
+         shared_sdofs[t] = new mfem::Array<int>;
+         for (int j = 0; j < ldof_map.Size(); j++)
+         {
+            (count[ldof_map[j]] > 1 ? shared_sdofs : excl_sdofs)[t]->Append(j);
+         }
+      }
+      for (int i = 0; i < lsize; i++)
+      {
+         if (count[i] != 1) { shared_ldof.Append(i); }
+      }
+   }
+
+   void Assemble()
+   {
+      const int num_chunks = chunks.Size();
+      #pragma omp parallel for schedule(static,1)
+      for (int t = 0; t < num_chunks; t++) { chunks[t]->Assemble(); }
+   }
+
+   virtual void Mult(const mfem::Vector &x, mfem::Vector &y) const
+   {
+      const int num_chunks = chunks.Size();
+      #pragma omp parallel for schedule(static,1)
+      for (int t = 0; t < num_chunks; t++)
+      {
+         chunks[t]->MultSubset(x);
+         const mfem::Array<int> &ldof_map = chunks[t]->GetLDofMap();
+         const mfem::Array<int> &excl = *excl_sdofs[t];
+         const mfem::Vector &y_s = chunks[t]->GetSubsetResult();
+         for (int j = 0; j < excl.Size(); j++)
+         {
+            y(ldof_map[excl[j]]) = y_s(excl[j]);
+         }
+      }
+      for (int i = 0; i < shared_ldof.Size(); i++) { y(shared_ldof[i]) = 0.0; }
+      for (int t = 0; t < num_chunks; t++)
+      {
+         const mfem::Array<int> &ldof_map = chunks[t]->GetLDofMap();
+         const mfem::Array<int> &shared = *shared_sdofs[t];
+         const mfem::Vector &y_s = chunks[t]->GetSubsetResult();
+         for (int j = 0; j < shared.Size(); j++)
+         {
+            y(ldof_map[shared[j]]) += y_s(shared[j]);
+         }
+      }
+   }
+
+   // Used by FormLinearSystem() and RecoverFEMSolution(), as in TBilinearForm
+   virtual const mfem::Operator *GetProlongation() const
+   { return pfes.GetProlongationMatrix(); }
+   virtual const mfem::Operator *GetRestriction() const
+   { return pfes.GetRestrictionMatrix(); }
+
+   int GetNumThreads() const { return chunks.Size(); }
+   int GetNumSharedDofs() const { return shared_ldof.Size(); }
+
+   virtual ~ThreadedElementOperator()
+   {
+      for (int t = 0; t < chunks.Size(); t++)
+      {
+         delete shared_sdofs[t];
+         delete excl_sdofs[t];
+         delete chunks[t];
+      }
+   }
+};
+
+#endif // CEED_BENCHMARKS_ELEMENT_SUBSET_HPP
@@ -0,0 +1,46 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project
+// (17-SC-20-SC), a collaborative effort of two U.S. Department of Energy
+// organizations (Office of Science and the National Nuclear Security
+// Administration) responsible for the planning and preparation of a capable
+// exascale ecosystem, including software, applications, hardware, advanced
+// system engineering and early testbed platforms, in support of the nation's
+// exascale computing imperative.
+
+// Heap allocation counter shared by the MFEM bake-off drivers,
+// mfem_bps/bp1_v1.cpp and mfem_bps_v2/bp.cpp. It replaces the global operator
+// new and delete, so it must be included in a single translation unit of the
+// program, the driver's main file.
+
+#ifndef CEED_BENCHMARKS_HEAP_COUNTER_HPP
+#define CEED_BENCHMARKS_HEAP_COUNTER_HPP
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Number of calls to the global operator new, i.e. of the C++ heap allocations
+// made by this program and by MFEM; allocations made from C code, e.g. inside
+// MPI or hypre, are not counted. Used to check that the steady-state solve
+// loop does not allocate.
+static std::atomic<long> num_heap_allocs(0);
+
+void *operator new(std::size_t size)
+{
+   num_heap_allocs.fetch_add(1, std::memory_order_relaxed);
+   if (void *p = std::malloc(size ? size : 1)) { return p; }
+   throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+
+#endif // CEED_BENCHMARKS_HEAP_COUNTER_HPP